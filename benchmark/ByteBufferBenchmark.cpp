@@ -0,0 +1,342 @@
+﻿#include "ByteBuffer/ByteBuffer.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <functional>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// every allocation made by the process is counted to report allocations per operation
+namespace
+{
+std::atomic<std::uint64_t> AllocationCount = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    ++AllocationCount;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace
+{
+// prevents compiler from optimizing away benchmarked code, value escapes and memory is assumed to be read
+template <typename T>
+void DoNotOptimize(T const& value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    static char const volatile* volatile sink;
+    sink = reinterpret_cast<char const volatile*>(&value);
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+struct BenchmarkResult
+{
+    std::string Name;
+    std::uint64_t Operations = 0;
+    std::uint64_t Bytes = 0;
+    double Seconds = 0.0;
+    std::uint64_t Allocations = 0;
+};
+
+class BenchmarkSuite
+{
+public:
+    explicit BenchmarkSuite(std::chrono::milliseconds minDuration) : _minDuration(minDuration) { }
+
+    // body performs one batch and returns number of operations and bytes processed in it
+    void Run(std::string name, std::function<std::pair<std::uint64_t, std::uint64_t>()> const& body)
+    {
+        body(); // warmup
+
+        BenchmarkResult result;
+        result.Name = std::move(name);
+
+        std::uint64_t allocationsBefore = AllocationCount;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        do
+        {
+            auto [operations, bytes] = body();
+            result.Operations += operations;
+            result.Bytes += bytes;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < _minDuration);
+
+        result.Seconds = std::chrono::duration<double>(elapsed).count();
+        result.Allocations = AllocationCount - allocationsBefore;
+        _results.push_back(std::move(result));
+    }
+
+    void Print() const
+    {
+        printf("{\n  \"benchmarks\": [\n");
+        for (std::size_t i = 0; i < _results.size(); ++i)
+        {
+            BenchmarkResult const& result = _results[i];
+            printf("    { \"name\": \"%s\", \"operations\": %llu, \"ns_per_op\": %.3f, \"bytes_per_second\": %.0f, \"allocations_per_op\": %.6f }%s\n",
+                result.Name.c_str(), static_cast<unsigned long long>(result.Operations), result.Seconds * 1e9 / result.Operations,
+                result.Bytes / result.Seconds, static_cast<double>(result.Allocations) / result.Operations, i + 1 < _results.size() ? "," : "");
+        }
+        printf("  ]\n}\n");
+    }
+
+private:
+    std::chrono::milliseconds _minDuration;
+    std::vector<BenchmarkResult> _results;
+};
+
+constexpr std::uint64_t BatchSize = 1 << 16;
+
+template <ByteBufferNumeric T>
+void BenchmarkTyped(BenchmarkSuite& suite, char const* typeName)
+{
+    suite.Run(std::string("append<") + typeName + ">", []
+    {
+        ByteBuffer buffer;
+        for (std::uint64_t i = 0; i < BatchSize; ++i)
+            buffer.append<T>(static_cast<T>(i));
+
+        DoNotOptimize(buffer.data());
+        return std::pair(BatchSize, BatchSize * sizeof(T));
+    });
+
+    ByteBuffer source;
+    for (std::uint64_t i = 0; i < BatchSize; ++i)
+        source.append<T>(static_cast<T>(i));
+
+    suite.Run(std::string("read<") + typeName + ">", [&]
+    {
+        source.rpos(0);
+        T sum = T();
+        for (std::uint64_t i = 0; i < BatchSize; ++i)
+            sum = static_cast<T>(sum + source.read<T>());
+
+        DoNotOptimize(sum);
+        return std::pair(BatchSize, BatchSize * sizeof(T));
+    });
+}
+
+void BenchmarkBits(BenchmarkSuite& suite)
+{
+    suite.Run("WriteBit", []
+    {
+        ByteBuffer buffer;
+        for (std::uint64_t i = 0; i < BatchSize; ++i)
+            buffer.WriteBit((i & 3) != 0);
+
+        buffer.FlushBits();
+        DoNotOptimize(buffer.data());
+        return std::pair(BatchSize, BatchSize / 8);
+    });
+
+    for (std::int32_t bits : { 3, 7, 13, 32 })
+    {
+        suite.Run("WriteBits/" + std::to_string(bits), [bits]
+        {
+            ByteBuffer buffer;
+            for (std::uint64_t i = 0; i < BatchSize; ++i)
+                buffer.WriteBits(i * 0x9E3779B1, bits);
+
+            buffer.FlushBits();
+            DoNotOptimize(buffer.data());
+            return std::pair(BatchSize, BatchSize * bits / 8);
+        });
+    }
+
+    // bit packs interleaved with bytes, as in typical packet structures
+    suite.Run("WriteBits/mixed", []
+    {
+        ByteBuffer buffer;
+        for (std::uint64_t i = 0; i < BatchSize; ++i)
+        {
+            buffer.WriteBit(true);
+            buffer.WriteBits(i, 5);
+            buffer.FlushBits();
+            buffer.append<std::uint32_t>(static_cast<std::uint32_t>(i));
+        }
+
+        DoNotOptimize(buffer.data());
+        return std::pair(BatchSize, BatchSize * 5);
+    });
+
+    ByteBuffer target(BatchSize * 4, ByteBuffer::Resize{ });
+    suite.Run("PutBits/17", [&]
+    {
+        for (std::uint64_t i = 0; i < BatchSize; ++i)
+            target.PutBits(i * 17, i, 17);
+
+        DoNotOptimize(target.data());
+        return std::pair(BatchSize, BatchSize * 17 / 8);
+    });
+}
+
+void BenchmarkStrings(BenchmarkSuite& suite)
+{
+    for (std::size_t length : { 0, 8, 64, 1024 })
+    {
+        ByteBuffer source;
+        std::string value(length, 'x');
+        std::uint64_t const count = std::max<std::uint64_t>(BatchSize / (length + 1), 64);
+        for (std::uint64_t i = 0; i < count; ++i)
+            source << value;
+
+        suite.Run("ReadCString/" + std::to_string(length), [source, count]() mutable
+        {
+            source.rpos(0);
+            std::size_t total = 0;
+            for (std::uint64_t i = 0; i < count; ++i)
+                total += source.ReadCString().length();
+
+            DoNotOptimize(total);
+            return std::pair(count, source.size());
+        });
+    }
+}
+
+void BenchmarkGrowth(BenchmarkSuite& suite, std::size_t growthSize)
+{
+    suite.Run("growth/" + std::to_string(growthSize >> 20) + "MB", [growthSize]
+    {
+        static std::array<std::uint8_t, 4096> const chunk = { };
+        ByteBuffer buffer;
+        std::uint64_t operations = 0;
+        while (buffer.size() < growthSize)
+        {
+            buffer.append(chunk.data(), chunk.size());
+            ++operations;
+        }
+
+        DoNotOptimize(buffer.data());
+        return std::pair(operations, static_cast<std::uint64_t>(buffer.size()));
+    });
+}
+
+// same write sequence as ProcessWDBRecord for a gameobject record, old per-field appends versus write cursor
+void BenchmarkRecords(BenchmarkSuite& suite)
+{
+    for (std::size_t recordSize : { 16, 128, 1024 })
+    {
+        std::vector<std::uint8_t> record(recordSize, 0xAB);
+        std::uint64_t const count = std::max<std::uint64_t>(BatchSize * 16 / (recordSize + 40), 64);
+
+        suite.Run("record/append/" + std::to_string(recordSize), [&record, count]
+        {
+            ByteBuffer pkt;
+            for (std::uint64_t i = 0; i < count; ++i)
+            {
+                std::size_t headerPos = pkt.wpos();
+                pkt << std::uint32_t(0x47534d53) << std::uint32_t(0) << std::uint32_t(0) << std::uint32_t(0) << std::uint32_t(0);
+                std::size_t pktPos = pkt.wpos();
+                pkt.append<std::uint32_t>(0x1234);
+                pkt.append<std::int32_t>(static_cast<std::int32_t>(i));
+                pkt.append<std::uint16_t>(0);
+                pkt.WriteBit(true);
+                pkt.FlushBits();
+                pkt.append<std::uint32_t>(1);
+                pkt.append(record.data(), record.size());
+                pkt.put<std::uint32_t>(headerPos + 16, static_cast<std::uint32_t>(pkt.wpos() - pktPos));
+            }
+
+            DoNotOptimize(pkt.data());
+            return std::pair(count, static_cast<std::uint64_t>(pkt.size()));
+        });
+
+        suite.Run("record/cursor/" + std::to_string(recordSize), [&record, count]
+        {
+            ByteBuffer pkt;
+            for (std::uint64_t i = 0; i < count; ++i)
+            {
+                ByteBuffer::WriteCursor cursor = pkt.BeginWrite(20 + 4 + 4 + 2 + 1 + 4 + record.size());
+                std::size_t headerPos = cursor.wpos();
+                cursor.append<std::uint32_t>(0x47534d53);
+                cursor.append<std::uint32_t>(0);
+                cursor.append<std::uint32_t>(0);
+                cursor.append<std::uint32_t>(0);
+                cursor.append<std::uint32_t>(0);
+                std::size_t pktPos = cursor.wpos();
+                cursor.append<std::uint32_t>(0x1234);
+                cursor.append<std::int32_t>(static_cast<std::int32_t>(i));
+                cursor.append<std::uint16_t>(0);
+                cursor.append<std::uint8_t>(0x80);
+                cursor.append<std::uint32_t>(1);
+                cursor.append(record.data(), record.size());
+                cursor.put<std::uint32_t>(headerPos + 16, static_cast<std::uint32_t>(cursor.wpos() - pktPos));
+                pkt.EndWrite(cursor);
+            }
+
+            DoNotOptimize(pkt.data());
+            return std::pair(count, static_cast<std::uint64_t>(pkt.size()));
+        });
+    }
+}
+
+std::size_t ParseSizeArgument(std::string_view value, std::size_t defaultValue)
+{
+    std::size_t result = 0;
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc())
+        return defaultValue;
+
+    switch (end != value.data() + value.size() ? *end : 0)
+    {
+        case 'K': return result << 10;
+        case 'M': return result << 20;
+        case 'G': return result << 30;
+        default: return result;
+    }
+}
+}
+
+// usage: ByteBufferBenchmark [--min-time <ms>] [--growth-size <size>]
+int main(int argc, char* argv[])
+{
+    std::size_t minTimeMs = 200;
+
+    // large WDB files produce multi-GB outputs, growth up to 4 GB is measured by default
+    std::vector<std::size_t> growthSizes = { std::size_t(256) << 20, std::size_t(4) << 30 };
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--min-time")
+            minTimeMs = ParseSizeArgument(argv[i + 1], minTimeMs);
+        else if (arg == "--growth-size")
+            growthSizes = { ParseSizeArgument(argv[i + 1], growthSizes.front()) };
+    }
+
+    BenchmarkSuite suite{ std::chrono::milliseconds(minTimeMs) };
+
+    BenchmarkTyped<std::uint8_t>(suite, "uint8");
+    BenchmarkTyped<std::uint16_t>(suite, "uint16");
+    BenchmarkTyped<std::uint32_t>(suite, "uint32");
+    BenchmarkTyped<std::uint64_t>(suite, "uint64");
+    BenchmarkTyped<float>(suite, "float");
+    BenchmarkTyped<double>(suite, "double");
+    BenchmarkBits(suite);
+    BenchmarkStrings(suite);
+    for (std::size_t growthSize : growthSizes)
+        BenchmarkGrowth(suite, growthSize);
+    BenchmarkRecords(suite);
+
+    suite.Print();
+    return 0;
+}
@@ -0,0 +1,316 @@
+﻿#include "BuildCache.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <fstream>
+#include <string_view>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+std::filesystem::path GetDirectory(std::filesystem::path const& input)
+{
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::absolute(input, error);
+    return error ? input.parent_path() : absolute.parent_path();
+}
+
+std::int64_t GetWriteTime(std::filesystem::path const& path, std::error_code& error)
+{
+    return std::filesystem::last_write_time(path, error).time_since_epoch().count();
+}
+
+template <typename T>
+bool ParseNumber(std::string_view text, T& value, int base = 10)
+{
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+// file name, size, write time, hash, converter version, outputs separated with |
+bool ParseEntry(std::string_view line, std::string& name, BuildCacheEntry& entry)
+{
+    std::array<std::string_view, 6> fields;
+    for (std::size_t i = 0; i < fields.size(); ++i)
+    {
+        std::size_t separator = i + 1 < fields.size() ? line.find('\t') : line.size();
+        if (separator == std::string_view::npos)
+            return false;
+
+        fields[i] = line.substr(0, separator);
+        line.remove_prefix(std::min(separator + 1, line.size()));
+    }
+
+    name = fields[0];
+    if (!ParseNumber(fields[1], entry.Size) || !ParseNumber(fields[2], entry.WriteTime) || !ParseNumber(fields[3], entry.Hash, 16))
+        return false;
+
+    entry.ConverterVersion = fields[4];
+    for (std::string_view outputs = fields[5]; !outputs.empty();)
+    {
+        std::size_t separator = std::min(outputs.find('|'), outputs.size());
+        entry.Outputs.emplace_back(outputs.substr(0, separator));
+        outputs.remove_prefix(std::min(separator + 1, outputs.size()));
+    }
+
+    return true;
+}
+
+// XXH64
+constexpr std::uint64_t Prime1 = 0x9E3779B185EBCA87;
+constexpr std::uint64_t Prime2 = 0xC2B2AE3D27D4EB4F;
+constexpr std::uint64_t Prime3 = 0x165667B19E3779F9;
+constexpr std::uint64_t Prime4 = 0x85EBCA77C2B2AE63;
+constexpr std::uint64_t Prime5 = 0x27D4EB2F165667C5;
+
+template <typename T>
+T ReadUnaligned(std::uint8_t const* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+std::uint64_t HashRound(std::uint64_t acc, std::uint64_t input)
+{
+    acc += input * Prime2;
+    acc = std::rotl(acc, 31);
+    return acc * Prime1;
+}
+
+std::uint64_t HashMergeRound(std::uint64_t acc, std::uint64_t value)
+{
+    acc ^= HashRound(0, value);
+    return acc * Prime1 + Prime4;
+}
+}
+
+std::uint64_t BuildCache::Hash(std::span<std::uint8_t const> data)
+{
+    std::uint8_t const* p = data.data();
+    std::uint8_t const* end = p + data.size();
+    std::uint64_t hash;
+
+    if (data.size() >= 32)
+    {
+        std::uint64_t v1 = Prime1 + Prime2;
+        std::uint64_t v2 = Prime2;
+        std::uint64_t v3 = 0;
+        std::uint64_t v4 = 0 - Prime1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = HashRound(v1, ReadUnaligned<std::uint64_t>(p));
+            v2 = HashRound(v2, ReadUnaligned<std::uint64_t>(p + 8));
+            v3 = HashRound(v3, ReadUnaligned<std::uint64_t>(p + 16));
+            v4 = HashRound(v4, ReadUnaligned<std::uint64_t>(p + 24));
+        }
+
+        hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        hash = HashMergeRound(hash, v1);
+        hash = HashMergeRound(hash, v2);
+        hash = HashMergeRound(hash, v3);
+        hash = HashMergeRound(hash, v4);
+    }
+    else
+        hash = Prime5;
+
+    hash += data.size();
+
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= HashRound(0, ReadUnaligned<std::uint64_t>(p));
+        hash = std::rotl(hash, 27) * Prime1 + Prime4;
+    }
+
+    if (p + 4 <= end)
+    {
+        hash ^= ReadUnaligned<std::uint32_t>(p) * Prime1;
+        hash = std::rotl(hash, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+
+    for (; p < end; ++p)
+    {
+        hash ^= *p * Prime5;
+        hash = std::rotl(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void BuildCache::Load(std::vector<std::filesystem::path> const& inputs)
+{
+    for (std::filesystem::path const& input : inputs)
+    {
+        std::filesystem::path directory = GetDirectory(input);
+        if (_manifests.contains(directory))
+            continue;
+
+        Manifest& manifest = _manifests[directory];
+
+        std::ifstream file(directory / FileName);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::string name;
+            BuildCacheEntry entry;
+            if (ParseEntry(line, name, entry))
+                manifest.Entries[name] = std::move(entry);
+        }
+    }
+}
+
+void BuildCache::Save()
+{
+    for (auto& [directory, manifest] : _manifests)
+    {
+        if (!manifest.Modified)
+            continue;
+
+        FILE* file = nullptr;
+        if (fopen_s(&file, (directory / FileName).string().c_str(), "w") || !file)
+            continue;
+
+        fprintf(file, "# file\tsize\twrite_time\thash\tconverter_version\toutputs\n");
+        for (auto const& [name, entry] : manifest.Entries)
+        {
+            std::string outputs;
+            for (std::string const& output : entry.Outputs)
+            {
+                if (!outputs.empty())
+                    outputs += '|';
+                outputs += output;
+            }
+
+            fprintf(file, "%s\t%ju\t%lld\t%016llx\t%s\t%s\n", name.c_str(), entry.Size, static_cast<long long>(entry.WriteTime),
+                static_cast<unsigned long long>(entry.Hash), entry.ConverterVersion.c_str(), outputs.c_str());
+        }
+
+        fclose(file);
+        manifest.Modified = false;
+    }
+}
+
+std::vector<std::filesystem::path> BuildCache::FilterUpToDate(std::vector<std::filesystem::path> const& inputs)
+{
+    struct HashCheck
+    {
+        std::size_t Input = 0;
+        Manifest* InputManifest = nullptr;
+        BuildCacheEntry* Entry = nullptr;
+        std::int64_t WriteTime = 0;
+        bool Unchanged = false;
+    };
+
+    std::vector<std::uint8_t> needsConversion(inputs.size(), 1);
+    std::vector<HashCheck> hashChecks;
+
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::optional<BuildCacheFileState> state = GetFileState(inputs[i]);
+        if (!state)
+            continue;
+
+        std::filesystem::path directory = GetDirectory(inputs[i]);
+        Manifest& manifest = _manifests[directory];
+        auto itr = manifest.Entries.find(inputs[i].filename().string());
+        if (itr == manifest.Entries.end())
+            continue;
+
+        BuildCacheEntry& entry = itr->second;
+        if (entry.ConverterVersion != _converterVersion || entry.Size != state->Size)
+            continue;
+
+        std::error_code error;
+        if (!std::ranges::all_of(entry.Outputs, [&](std::string const& output) { return std::filesystem::exists(directory / output, error); }))
+            continue;
+
+        if (entry.WriteTime == state->WriteTime)
+            needsConversion[i] = 0;
+        else
+            hashChecks.push_back({ .Input = i, .InputManifest = &manifest, .Entry = &entry, .WriteTime = state->WriteTime });
+    }
+
+    if (!hashChecks.empty())
+    {
+        std::atomic<std::size_t> nextCheck = 0;
+        std::vector<std::jthread> workers;
+        std::size_t workerCount = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), hashChecks.size());
+        for (std::size_t i = 0; i < workerCount; ++i)
+        {
+            workers.emplace_back([&]
+            {
+                for (std::size_t check = nextCheck++; check < hashChecks.size(); check = nextCheck++)
+                {
+                    MappedFile file;
+                    hashChecks[check].Unchanged = file.Open(inputs[hashChecks[check].Input]) && Hash(file.span()) == hashChecks[check].Entry->Hash;
+                }
+            });
+        }
+    }
+
+    // only modification time changed, remember new one to avoid hashing next time
+    for (HashCheck const& check : hashChecks)
+    {
+        if (!check.Unchanged)
+            continue;
+
+        needsConversion[check.Input] = 0;
+        check.Entry->WriteTime = check.WriteTime;
+        check.InputManifest->Modified = true;
+    }
+
+    std::vector<std::filesystem::path> result;
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+        if (needsConversion[i])
+            result.push_back(inputs[i]);
+
+    return result;
+}
+
+std::optional<BuildCacheFileState> BuildCache::GetFileState(std::filesystem::path const& input)
+{
+    std::error_code error;
+    BuildCacheFileState state;
+    state.Size = std::filesystem::file_size(input, error);
+    if (error)
+        return std::nullopt;
+
+    state.WriteTime = GetWriteTime(input, error);
+    if (error)
+        return std::nullopt;
+
+    return state;
+}
+
+void BuildCache::Update(std::filesystem::path const& input, BuildCacheFileState const& state, std::uint64_t hash, std::vector<std::filesystem::path> const& outputs)
+{
+    BuildCacheEntry entry;
+    entry.Size = state.Size;
+    entry.WriteTime = state.WriteTime;
+    entry.Hash = hash;
+    entry.ConverterVersion = _converterVersion;
+    for (std::filesystem::path const& output : outputs)
+        entry.Outputs.push_back(output.filename().string());
+
+    std::filesystem::path directory = GetDirectory(input);
+
+    std::scoped_lock lock(_lock);
+    Manifest& manifest = _manifests[directory];
+    manifest.Entries[input.filename().string()] = std::move(entry);
+    manifest.Modified = true;
+}
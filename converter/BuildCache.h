@@ -0,0 +1,66 @@
+﻿#ifndef WDB_TO_PKT_BUILD_CACHE_H
+#define WDB_TO_PKT_BUILD_CACHE_H
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// size and modification time of an input, taken before its contents are read
+struct BuildCacheFileState
+{
+    std::uintmax_t Size = 0;
+    std::int64_t WriteTime = 0;
+};
+
+struct BuildCacheEntry
+{
+    std::uintmax_t Size = 0;
+    std::int64_t WriteTime = 0;
+    std::uint64_t Hash = 0;
+    std::string ConverterVersion;
+    std::vector<std::string> Outputs; // file names, in the same directory as input
+};
+
+/**
+  * @name   BuildCache
+  * @brief  Remembers which inputs were already converted, stored as WDBtoPKT.cache in every input directory.
+  *         An input is up to date when converter version matches, all its outputs exist and
+  *         either size and modification time or size and content hash are unchanged.
+*/
+class BuildCache
+{
+public:
+    static constexpr char const* FileName = "WDBtoPKT.cache";
+
+    explicit BuildCache(std::string converterVersion) : _converterVersion(std::move(converterVersion)) { }
+
+    void Load(std::vector<std::filesystem::path> const& inputs);
+    void Save();
+
+    // returns inputs that need to be converted, hashing files whose modification time changed in parallel
+    std::vector<std::filesystem::path> FilterUpToDate(std::vector<std::filesystem::path> const& inputs);
+
+    // state must be read before the data that was hashed and converted, so that a file changed meanwhile is converted again next time
+    void Update(std::filesystem::path const& input, BuildCacheFileState const& state, std::uint64_t hash, std::vector<std::filesystem::path> const& outputs);
+
+    static std::optional<BuildCacheFileState> GetFileState(std::filesystem::path const& input);
+    static std::uint64_t Hash(std::span<std::uint8_t const> data);
+
+private:
+    struct Manifest
+    {
+        std::map<std::string, BuildCacheEntry> Entries;
+        bool Modified = false;
+    };
+
+    std::string _converterVersion;
+    std::mutex _lock;
+    std::map<std::filesystem::path, Manifest> _manifests; // by directory
+};
+
+#endif
@@ -20,6 +20,8 @@
 #include <format>
 #include <cmath>
 
+ByteBuffer::ReallocationHook ByteBuffer::_reallocationHook = nullptr;
+
 ByteBufferPositionException::ByteBufferPositionException(size_t pos, size_t size, size_t valueSize)
     : ByteBufferException(std::format("Attempted to get value with size: {} in ByteBuffer (pos: {} size: {})", valueSize, pos, size))
 {
@@ -78,12 +80,10 @@ std::string_view ByteBuffer::ReadString(std::uint32_t length)
     return value;
 }
 
-void ByteBuffer::append(std::uint8_t const* src, size_t cnt)
+void ByteBuffer::Grow(size_t newSize)
 {
-    FlushBits();
-
-    size_t const newSize = _wpos + cnt;
-    if (_storage.capacity() < newSize) // custom memory allocation rules
+    size_t const oldCapacity = _storage.capacity();
+    if (oldCapacity < newSize) // custom memory allocation rules
     {
         if (newSize < 100)
             _storage.reserve(300);
@@ -97,6 +97,18 @@ void ByteBuffer::append(std::uint8_t const* src, size_t cnt)
 
     if (_storage.size() < newSize)
         _storage.resize(newSize);
+
+    if (_storage.capacity() != oldCapacity && _reallocationHook)
+        _reallocationHook(oldCapacity, _storage.capacity());
+}
+
+void ByteBuffer::append(std::uint8_t const* src, size_t cnt)
+{
+    FlushBits();
+
+    size_t const newSize = _wpos + cnt;
+    Grow(newSize);
+
     std::memcpy(&_storage[_wpos], src, cnt);
     _wpos = newSize;
 }
@@ -106,6 +118,24 @@ void ByteBuffer::put(size_t pos, std::uint8_t const* src, size_t cnt)
     std::memcpy(&_storage[pos], src, cnt);
 }
 
+ByteBuffer::WriteCursor ByteBuffer::BeginWrite(size_t maxSize)
+{
+    FlushBits();
+
+    size_t const storageSize = _storage.size();
+    Grow(_wpos + maxSize);
+
+    return WriteCursor(_storage.data() + _wpos, _wpos, storageSize);
+}
+
+void ByteBuffer::EndWrite(WriteCursor const& cursor)
+{
+    _wpos = cursor.wpos();
+
+    // drop unused part of reserved space, but keep anything that was in storage before BeginWrite
+    _storage.resize(std::max(_wpos, cursor._storageSize));
+}
+
 void ByteBuffer::PutBits(std::size_t pos, std::size_t value, std::uint32_t bitCount)
 {
     for (std::uint32_t i = 0; i < bitCount; ++i)
@@ -19,9 +19,14 @@
 #define TRINITYCORE_BYTE_BUFFER_H
 
 #include <array>
+#include <bit>
 #include <concepts>
+#include <expected>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include <cstddef>
 #include <cstring>
 
 // Root of ByteBuffer exception hierarchy
@@ -37,10 +42,19 @@ protected:
     std::string msg_;
 };
 
+// Returned by non-throwing try_read functions and readers of memory mapped files, carries the same information as ByteBufferPositionException
+struct ByteBufferPositionError
+{
+    size_t Pos = 0;
+    size_t Size = 0;
+    size_t ValueSize = 0;
+};
+
 class ByteBufferPositionException : public ByteBufferException
 {
 public:
     ByteBufferPositionException(size_t pos, size_t size, size_t valueSize);
+    explicit ByteBufferPositionException(ByteBufferPositionError const& error) : ByteBufferPositionException(error.Pos, error.Size, error.ValueSize) { }
 };
 
 class ByteBufferInvalidValueException : public ByteBufferException
@@ -57,6 +71,13 @@ concept ByteBufferNumeric = std::same_as<T, std::int8_t> || std::same_as<T, std:
     || std::same_as<T, float> || std::same_as<T, double>
     || std::same_as<T, char> || std::is_enum_v<T>;
 
+// Specialized for structs that can be read and written as a whole, see ByteBufferFieldList
+template <typename T>
+struct ByteBufferStructDescriptor;
+
+template <typename T>
+concept ByteBufferDescribedStruct = requires { { ByteBufferStructDescriptor<T>::IsContiguous } -> std::convertible_to<bool>; };
+
 class ByteBuffer
 {
     public:
@@ -67,6 +88,61 @@ class ByteBuffer
         struct Reserve { };
         struct Resize { };
 
+        /**
+          * @name   WriteCursor
+          * @brief  Unchecked writer over storage reserved by BeginWrite.
+          *         Writes perform no bounds checks, bit flushing or reallocation,
+          *         the caller must not write more than the size passed to BeginWrite.
+          *         Written data becomes part of the buffer after EndWrite.
+        */
+        class WriteCursor
+        {
+            friend class ByteBuffer;
+
+        public:
+            template <ByteBufferNumeric T>
+            void append(T value)
+            {
+                std::memcpy(_pos, &value, sizeof(value));
+                _pos += sizeof(value);
+            }
+
+            void append(std::uint8_t const* src, size_t cnt)
+            {
+                std::memcpy(_pos, src, cnt);
+                _pos += cnt;
+            }
+
+            template <ByteBufferNumeric T, std::size_t Size>
+            void append(std::array<T, Size> const& arr)
+            {
+                append(reinterpret_cast<std::uint8_t const*>(arr.data()), Size * sizeof(T));
+            }
+
+            template <ByteBufferDescribedStruct T>
+            void append(T const& value)
+            {
+                ByteBufferStructDescriptor<T>::Write(*this, value);
+            }
+
+            // pos is absolute position in ByteBuffer, must be within already written part of the cursor
+            template <ByteBufferNumeric T>
+            void put(size_t pos, T value)
+            {
+                std::memcpy(_begin + (pos - _wpos), &value, sizeof(value));
+            }
+
+            size_t wpos() const { return _wpos + (_pos - _begin); }
+
+        private:
+            WriteCursor(std::uint8_t* begin, size_t wpos, size_t storageSize) : _begin(begin), _pos(begin), _wpos(wpos), _storageSize(storageSize) { }
+
+            std::uint8_t* _begin;
+            std::uint8_t* _pos;
+            size_t _wpos;
+            size_t _storageSize;
+        };
+
         // constructor
         explicit ByteBuffer() : ByteBuffer(DEFAULT_SIZE, Reserve{}) { }
 
@@ -527,6 +603,66 @@ class ByteBuffer
             read(arr.data(), Size);
         }
 
+        template <ByteBufferDescribedStruct T>
+        void read(T& value)
+        {
+            ByteBufferStructDescriptor<T>::Read(*this, value);
+        }
+
+        /// Non-throwing variants of read functions, on failure read position is not modified
+        template <ByteBufferNumeric T>
+        std::expected<T, ByteBufferPositionError> try_read()
+        {
+            if (_rpos + sizeof(T) > _storage.size())
+                return std::unexpected(ByteBufferPositionError{ _rpos, _storage.size(), sizeof(T) });
+
+            ResetBitPos();
+            T val;
+            std::memcpy(&val, &_storage[_rpos], sizeof(T));
+            _rpos += sizeof(T);
+            return val;
+        }
+
+        std::expected<void, ByteBufferPositionError> try_read(std::uint8_t* dest, size_t len)
+        {
+            if (_rpos + len > _storage.size())
+                return std::unexpected(ByteBufferPositionError{ _rpos, _storage.size(), len });
+
+            ResetBitPos();
+            std::memcpy(dest, &_storage[_rpos], len);
+            _rpos += len;
+            return {};
+        }
+
+        template <ByteBufferNumeric T, size_t Size>
+        std::expected<void, ByteBufferPositionError> try_read(std::array<T, Size>& arr)
+        {
+            return try_read(reinterpret_cast<std::uint8_t*>(arr.data()), Size * sizeof(T));
+        }
+
+        template <ByteBufferDescribedStruct T>
+        std::expected<void, ByteBufferPositionError> try_read(T& value)
+        {
+            if (_rpos + ByteBufferStructDescriptor<T>::SerializedSize > _storage.size())
+                return std::unexpected(ByteBufferPositionError{ _rpos, _storage.size(), ByteBufferStructDescriptor<T>::SerializedSize });
+
+            ByteBufferStructDescriptor<T>::Read(*this, value);
+            return {};
+        }
+
+        template <ByteBufferNumeric T>
+        std::expected<void, ByteBufferPositionError> try_read_skip() { return try_read_skip(sizeof(T)); }
+
+        std::expected<void, ByteBufferPositionError> try_read_skip(size_t skip)
+        {
+            if (_rpos + skip > _storage.size())
+                return std::unexpected(ByteBufferPositionError{ _rpos, _storage.size(), skip });
+
+            ResetBitPos();
+            _rpos += skip;
+            return {};
+        }
+
         //! Method for writing strings that have their length sent separately in packet
         //! without null-terminating the string
         void WriteString(std::string const& str)
@@ -598,15 +734,36 @@ class ByteBuffer
             this->append(arr.data(), Size);
         }
 
+        template <ByteBufferDescribedStruct T>
+        void append(T const& value)
+        {
+            ByteBufferStructDescriptor<T>::Write(*this, value);
+        }
+
         void put(size_t pos, std::uint8_t const* src, size_t cnt);
 
+        /// Reserves maxSize bytes after current write position and returns unchecked cursor for writing them
+        WriteCursor BeginWrite(size_t maxSize);
+
+        /// Commits data written by cursor, no other writes may happen between BeginWrite and EndWrite
+        void EndWrite(WriteCursor const& cursor);
+
         [[noreturn]] void OnInvalidPosition(size_t pos, size_t valueSize) const;
 
+        /// Called after storage of any buffer is reallocated, must be set before buffers are used from multiple threads
+        using ReallocationHook = void(*)(size_t oldCapacity, size_t newCapacity);
+        static void SetReallocationHook(ReallocationHook hook) { _reallocationHook = hook; }
+
     protected:
+        // reserves storage according to allocation rules and extends it to at least newSize
+        void Grow(size_t newSize);
+
         size_t _rpos, _wpos;
         std::uint8_t _bitpos;
         std::uint8_t _curbitval;
         std::vector<std::uint8_t> _storage;
+
+        static ReallocationHook _reallocationHook;
 };
 
 extern template char ByteBuffer::read<char>();
@@ -625,4 +782,115 @@ template <typename T>
 concept HasByteBufferShiftOperators = requires(ByteBuffer& data, T const& value) { { data << value } -> std::convertible_to<ByteBuffer&>; }
                                    && requires(ByteBuffer& data, T& value)       { { data >> value } -> std::convertible_to<ByteBuffer&>; };
 
+template <typename T>
+struct ByteBufferMemberPointerTraits;
+
+template <typename Class, typename Member>
+struct ByteBufferMemberPointerTraits<Member Class::*>
+{
+    using ClassType = Class;
+    using MemberType = Member;
+};
+
+// Types whose in-memory representation on little endian machine is identical to serialized form
+template <typename T>
+struct ByteBufferRawLayout : std::bool_constant<ByteBufferNumeric<T>> { };
+
+template <typename T, std::size_t Size>
+struct ByteBufferRawLayout<std::array<T, Size>> : ByteBufferRawLayout<T> { };
+
+template <auto MemberPtr, std::size_t MemberOffset>
+struct ByteBufferField
+{
+    using ClassType = typename ByteBufferMemberPointerTraits<decltype(MemberPtr)>::ClassType;
+    using Type = typename ByteBufferMemberPointerTraits<decltype(MemberPtr)>::MemberType;
+
+    static constexpr auto Member = MemberPtr;
+    static constexpr std::size_t Offset = MemberOffset;
+    static constexpr std::size_t Size = sizeof(Type);
+};
+
+#define BYTEBUFFER_FIELD(type, member) ByteBufferField<&type::member, offsetof(type, member)>
+
+/**
+  * @name   ByteBufferFieldList
+  * @brief  Describes serialized layout of a struct as an ordered list of its fields.
+  *         ByteBufferStructDescriptor<T> specializations derive from it to enable
+  *         ByteBuffer::append/read and shift operators for T.
+  *         When the fields cover the whole struct without padding and machine is little endian
+  *         the entire struct is copied at once, otherwise each field is written separately.
+*/
+template <typename T, typename... Fields>
+struct ByteBufferFieldList
+{
+    static_assert(std::is_standard_layout_v<T>, "described struct must be standard layout");
+    static_assert((std::same_as<typename Fields::ClassType, T> && ...), "all fields must belong to described struct");
+
+    static constexpr std::size_t SerializedSize = (Fields::Size + ... + 0);
+
+    static constexpr bool IsContiguous = []
+    {
+        std::size_t offset = 0;
+        return ((Fields::Offset == std::exchange(offset, Fields::Offset + Fields::Size)) && ...) && offset == sizeof(T);
+    }();
+
+    static constexpr bool IsTriviallySerializable = IsContiguous
+        && std::endian::native == std::endian::little
+        && std::is_trivially_copyable_v<T>
+        && (ByteBufferRawLayout<typename Fields::Type>::value && ...);
+
+    template <typename Buffer>
+    static void Write(Buffer& data, T const& value)
+    {
+        if constexpr (IsTriviallySerializable)
+            data.append(reinterpret_cast<std::uint8_t const*>(&value), sizeof(T));
+        else
+            (WriteField<typename Fields::Type>(data, value.*Fields::Member), ...);
+    }
+
+    static void Read(ByteBuffer& data, T& value)
+    {
+        if constexpr (IsTriviallySerializable)
+            data.read(reinterpret_cast<std::uint8_t*>(&value), sizeof(T));
+        else
+            (ReadField<Fields>(data, value), ...);
+    }
+
+private:
+    template <typename F, typename Buffer>
+    static void WriteField(Buffer& data, F value)
+    {
+        if constexpr (ByteBufferNumeric<F>)
+            data.template append<F>(value);
+        else
+            data.append(value);
+    }
+
+    template <typename Field>
+    static void ReadField(ByteBuffer& data, T& value)
+    {
+        typename Field::Type field;
+        if constexpr (ByteBufferNumeric<typename Field::Type>)
+            field = data.template read<typename Field::Type>();
+        else
+            data.read(field);
+
+        value.*Field::Member = field;
+    }
+};
+
+template <ByteBufferDescribedStruct T>
+inline ByteBuffer& operator<<(ByteBuffer& data, T const& value)
+{
+    data.append(value);
+    return data;
+}
+
+template <ByteBufferDescribedStruct T>
+inline ByteBuffer& operator>>(ByteBuffer& data, T& value)
+{
+    data.read(value);
+    return data;
+}
+
 #endif
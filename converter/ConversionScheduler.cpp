@@ -0,0 +1,63 @@
+﻿#include "ConversionScheduler.h"
+#include <algorithm>
+#include <thread>
+
+ConversionScheduler::ConversionScheduler(std::size_t memoryBudget, std::size_t maxConcurrentJobs)
+    : _memoryBudget(memoryBudget), _maxConcurrentJobs(std::max<std::size_t>(maxConcurrentJobs, 1))
+{
+}
+
+bool ConversionScheduler::CanAdmit(ConversionJob const& job) const
+{
+    if (!_runningJobs)
+        return true;
+
+    if (_exclusiveRunning || IsExclusive(job))
+        return false;
+
+    return !_memoryBudget || _usedMemory + job.EstimatedMemory <= _memoryBudget;
+}
+
+void ConversionScheduler::Run(std::vector<ConversionJob> const& jobs, std::function<void(ConversionJob const&)> const& convert)
+{
+    _nextJob = 0;
+
+    auto worker = [&]
+    {
+        std::unique_lock lock(_lock);
+        while (true)
+        {
+            // jobs are admitted strictly in order, a large job blocks admission of everything after it
+            _stateChanged.wait(lock, [&] { return _nextJob >= jobs.size() || CanAdmit(jobs[_nextJob]); });
+            if (_nextJob >= jobs.size())
+                return;
+
+            ConversionJob const& job = jobs[_nextJob++];
+            bool exclusive = IsExclusive(job);
+            ++_runningJobs;
+            _usedMemory += job.EstimatedMemory;
+            _peakMemory = std::max(_peakMemory, _usedMemory);
+            _exclusiveRunning = exclusive;
+
+            // next job might fit too
+            _stateChanged.notify_all();
+
+            lock.unlock();
+            convert(job);
+            lock.lock();
+
+            --_runningJobs;
+            _usedMemory -= job.EstimatedMemory;
+            if (exclusive)
+                _exclusiveRunning = false;
+
+            _stateChanged.notify_all();
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    std::size_t workerCount = std::min(_maxConcurrentJobs, jobs.size());
+    workers.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i)
+        workers.emplace_back(worker);
+}
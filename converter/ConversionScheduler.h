@@ -0,0 +1,48 @@
+﻿#ifndef WDB_TO_PKT_CONVERSION_SCHEDULER_H
+#define WDB_TO_PKT_CONVERSION_SCHEDULER_H
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+struct ConversionJob
+{
+    std::filesystem::path Path;
+    std::size_t EstimatedMemory = 0;
+};
+
+/**
+  * @name   ConversionScheduler
+  * @brief  Runs conversion jobs concurrently in input order, admitting a job only while the sum of
+  *         estimated memory of running jobs fits in the budget.
+  *         Jobs larger than the entire budget run alone.
+*/
+class ConversionScheduler
+{
+public:
+    // memoryBudget = 0 means unlimited
+    explicit ConversionScheduler(std::size_t memoryBudget, std::size_t maxConcurrentJobs);
+
+    void Run(std::vector<ConversionJob> const& jobs, std::function<void(ConversionJob const&)> const& convert);
+
+    std::size_t GetPeakMemory() const { return _peakMemory; }
+
+private:
+    bool CanAdmit(ConversionJob const& job) const;
+    bool IsExclusive(ConversionJob const& job) const { return _memoryBudget && job.EstimatedMemory > _memoryBudget; }
+
+    std::size_t _memoryBudget;
+    std::size_t _maxConcurrentJobs;
+
+    std::mutex _lock;
+    std::condition_variable _stateChanged;
+    std::size_t _nextJob = 0;
+    std::size_t _runningJobs = 0;
+    std::size_t _usedMemory = 0;
+    std::size_t _peakMemory = 0;
+    bool _exclusiveRunning = false;
+};
+
+#endif
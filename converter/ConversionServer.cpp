@@ -0,0 +1,351 @@
+﻿#include "ConversionServer.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <string_view>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <WinSock2.h>
+#include <afunix.h>
+#include <AclAPI.h>
+
+namespace
+{
+constexpr std::intptr_t InvalidSocket = -1;
+
+// blocking calls wake up this often (ms) to notice shutdown requested by another connection
+constexpr int StopCheckInterval = 100;
+
+// longest request line, longer ones can't be answered and close the connection
+constexpr std::size_t MaxRequestLineSize = 64 * 1024;
+
+SOCKET ToHandle(std::intptr_t socket) { return static_cast<SOCKET>(socket); }
+int PollSocket(SOCKET socket, int timeout) { WSAPOLLFD fd = { socket, POLLIN, 0 }; return WSAPoll(&fd, 1, timeout); }
+
+bool SetNonBlocking(SOCKET socket, bool nonBlocking)
+{
+    u_long mode = nonBlocking;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+}
+
+// connecting to AF_UNIX socket requires write access to its file, only the user running the server gets any
+bool RestrictToCurrentUser(std::filesystem::path const& path)
+{
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token))
+        return false;
+
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<std::uint8_t> user(size);
+    bool success = size && GetTokenInformation(token, TokenUser, user.data(), size, &size);
+    CloseHandle(token);
+    if (!success)
+        return false;
+
+    EXPLICIT_ACCESS_W access = { };
+    access.grfAccessPermissions = GENERIC_ALL;
+    access.grfAccessMode = SET_ACCESS;
+    access.grfInheritance = NO_INHERITANCE;
+    access.Trustee.TrusteeForm = TRUSTEE_IS_SID;
+    access.Trustee.TrusteeType = TRUSTEE_IS_USER;
+    access.Trustee.ptstrName = reinterpret_cast<LPWSTR>(reinterpret_cast<TOKEN_USER const*>(user.data())->User.Sid);
+
+    PACL acl = nullptr;
+    if (SetEntriesInAclW(1, &access, nullptr, &acl) != ERROR_SUCCESS)
+        return false;
+
+    // protected DACL does not inherit entries of the directory
+    std::wstring name = path.wstring();
+    DWORD result = SetNamedSecurityInfoW(name.data(), SE_FILE_OBJECT, DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION,
+        nullptr, nullptr, acl, nullptr);
+    LocalFree(acl);
+    return result == ERROR_SUCCESS;
+}
+
+// buffered reader of tab separated request lines and inline payloads
+class ConnectionReader
+{
+public:
+    ConnectionReader(SOCKET socket, std::atomic<bool> const& stopping) : _socket(socket), _stopping(stopping) { }
+
+    enum class LineResult
+    {
+        Read,
+        Closed,
+        TooLong
+    };
+
+    LineResult ReadLine(std::string& line)
+    {
+        std::size_t end;
+        while ((end = _buffer.find('\n', _pos)) == std::string::npos)
+        {
+            if (_buffer.size() - _pos > MaxRequestLineSize)
+                return LineResult::TooLong;
+
+            if (!Receive())
+                return LineResult::Closed;
+        }
+
+        if (end - _pos > MaxRequestLineSize)
+            return LineResult::TooLong;
+
+        line.assign(_buffer, _pos, end - _pos);
+        if (line.ends_with('\r'))
+            line.pop_back();
+
+        _pos = end + 1;
+        return LineResult::Read;
+    }
+
+    bool ReadData(std::vector<std::uint8_t>& data)
+    {
+        std::size_t filled = 0;
+        while (filled < data.size())
+        {
+            if (_pos == _buffer.size() && !Receive())
+                return false;
+
+            std::size_t count = std::min(data.size() - filled, _buffer.size() - _pos);
+            std::memcpy(data.data() + filled, _buffer.data() + _pos, count);
+            filled += count;
+            _pos += count;
+        }
+
+        return true;
+    }
+
+private:
+    bool Receive()
+    {
+        _buffer.erase(0, _pos);
+        _pos = 0;
+
+        // idle connections are closed on shutdown
+        int ready;
+        while ((ready = PollSocket(_socket, StopCheckInterval)) == 0)
+            if (_stopping)
+                return false;
+
+        if (ready < 0)
+            return false;
+
+        char chunk[64 * 1024];
+        int received = recv(_socket, chunk, sizeof(chunk), 0);
+        if (received <= 0)
+            return false;
+
+        _buffer.append(chunk, received);
+        return true;
+    }
+
+    SOCKET _socket;
+    std::atomic<bool> const& _stopping;
+    std::string _buffer;
+    std::size_t _pos = 0;
+};
+
+bool SendLine(SOCKET socket, std::string line)
+{
+    line += '\n';
+    std::size_t sent = 0;
+    while (sent < line.size())
+    {
+        int count = send(socket, line.data() + sent, static_cast<int>(line.size() - sent), 0);
+        if (count <= 0)
+            return false;
+
+        sent += count;
+    }
+
+    return true;
+}
+
+std::vector<std::string> SplitFields(std::string_view line)
+{
+    std::vector<std::string> fields;
+    while (!line.empty())
+    {
+        std::size_t end = line.find('\t');
+        fields.emplace_back(line.substr(0, end));
+        line = end == std::string_view::npos ? std::string_view() : line.substr(end + 1);
+    }
+
+    return fields;
+}
+}
+
+ConversionServer::ConversionServer(std::filesystem::path socketPath, std::size_t workerCount, Handler handler)
+    : _socketPath(std::move(socketPath)), _workerCount(std::max<std::size_t>(workerCount, 1)), _handler(std::move(handler)), _listener(InvalidSocket)
+{
+}
+
+ConversionServer::~ConversionServer()
+{
+    if (_listener == InvalidSocket)
+        return;
+
+    closesocket(ToHandle(_listener));
+
+    std::error_code error;
+    std::filesystem::remove(_socketPath, error);
+}
+
+bool ConversionServer::Listen()
+{
+    sockaddr_un address = { };
+    address.sun_family = AF_UNIX;
+
+    std::string path = _socketPath.string();
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        printf("Socket path %s is too long\n", path.c_str());
+        return false;
+    }
+
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        printf("Failed to initialize sockets\n");
+        return false;
+    }
+
+    SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == INVALID_SOCKET)
+    {
+        printf("Failed to create socket\n");
+        return false;
+    }
+
+    // socket file left behind by previous server that did not shut down cleanly
+    std::error_code error;
+    std::filesystem::remove(_socketPath, error);
+
+    // access is restricted before listening, so no other user can connect meanwhile
+    // workers poll for connections, whichever loses the race to accept must not block
+    if (bind(listener, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0 || !RestrictToCurrentUser(_socketPath)
+        || listen(listener, SOMAXCONN) != 0 || !SetNonBlocking(listener, true))
+    {
+        printf("Failed to listen on %s\n", path.c_str());
+        closesocket(listener);
+        return false;
+    }
+
+    _listener = static_cast<std::intptr_t>(listener);
+    return true;
+}
+
+void ConversionServer::Run()
+{
+    auto worker = [&](std::size_t index)
+    {
+        while (!_stopping)
+        {
+            if (PollSocket(ToHandle(_listener), StopCheckInterval) <= 0)
+                continue;
+
+            SOCKET connection = accept(ToHandle(_listener), nullptr, nullptr);
+            if (connection == INVALID_SOCKET)
+            {
+                // connection was taken by another worker, anything else (e.g. out of handles) is retried after a while
+                if (WSAGetLastError() != WSAEWOULDBLOCK)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(StopCheckInterval));
+
+                continue;
+            }
+
+            // accepted sockets inherit non-blocking mode on Windows
+            try
+            {
+                if (!_stopping && SetNonBlocking(connection, false))
+                    ServeConnection(static_cast<std::intptr_t>(connection), index);
+            }
+            catch (std::exception const& ex)
+            {
+                // e.g. inline data too large to allocate, only this connection is dropped
+                printf("Caught exception when serving connection: %s\n", ex.what());
+            }
+
+            closesocket(connection);
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    workers.reserve(_workerCount);
+    for (std::size_t i = 0; i < _workerCount; ++i)
+        workers.emplace_back(worker, i);
+}
+
+void ConversionServer::Stop()
+{
+    // workers notice it within StopCheckInterval, requests being processed are still answered
+    _stopping = true;
+}
+
+void ConversionServer::ServeConnection(std::intptr_t connection, std::size_t worker)
+{
+    SOCKET socket = ToHandle(connection);
+    ConnectionReader reader(socket, _stopping);
+    std::string line;
+    while (!_stopping)
+    {
+        ConnectionReader::LineResult result = reader.ReadLine(line);
+        if (result == ConnectionReader::LineResult::TooLong)
+            SendLine(socket, std::format("ERROR\trequest line is longer than {} bytes", MaxRequestLineSize));
+
+        if (result != ConnectionReader::LineResult::Read)
+            return;
+
+        std::vector<std::string> fields = SplitFields(line);
+        if (fields.empty())
+            continue;
+
+        std::string command = std::move(fields.front());
+        fields.erase(fields.begin());
+
+        if (command == "shutdown")
+        {
+            SendLine(socket, "OK");
+            Stop();
+            return;
+        }
+
+        ServerRequest request;
+        if (command == "convert-data")
+        {
+            std::size_t size = 0;
+            std::string_view sizeField = fields.empty() ? std::string_view() : std::string_view(fields.back());
+            auto [end, error] = std::from_chars(sizeField.data(), sizeField.data() + sizeField.size(), size);
+            if (error != std::errc() || end != sizeField.data() + sizeField.size() || size > MaxInlineDataSize)
+            {
+                // payload length is unknown, rest of the stream can't be parsed
+                SendLine(socket, "ERROR\tinvalid data size");
+                return;
+            }
+
+            fields.pop_back();
+            request.Data.emplace(size);
+            if (!reader.ReadData(*request.Data))
+                return;
+        }
+        else if (command != "convert")
+        {
+            if (!SendLine(socket, "ERROR\tunknown command " + command))
+                return;
+
+            continue;
+        }
+
+        request.Arguments = std::move(fields);
+        if (!SendLine(socket, _handler(request, worker)))
+            return;
+    }
+}
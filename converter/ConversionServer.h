@@ -0,0 +1,60 @@
+﻿#ifndef WDB_TO_PKT_CONVERSION_SERVER_H
+#define WDB_TO_PKT_CONVERSION_SERVER_H
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct ServerRequest
+{
+    std::vector<std::string> Arguments;             // command line options followed by a single input path
+    std::optional<std::vector<std::uint8_t>> Data;  // inline WDB contents, output is still written next to input path
+};
+
+/**
+  * @name   ConversionServer
+  * @brief  Accepts conversion requests over a local (AF_UNIX) stream socket and answers each with a single status line.
+  *         Every request is a line of tab separated fields, first one being the command:
+  *             convert <arguments...> <path>
+  *             convert-data <arguments...> <path> <size>, followed by size bytes of WDB
+  *             shutdown
+  *         A fixed number of workers serve one connection each at a time, requests of the same connection are processed in order.
+  *         Only the user running the server is granted access to the socket file, so no other user can connect.
+  *         Request lines longer than MaxRequestLineSize are answered with ERROR and close the connection.
+*/
+class ConversionServer
+{
+public:
+    static constexpr std::size_t MaxInlineDataSize = std::size_t(1) << 30;
+
+    // worker is index of the calling worker, state kept per worker does not need synchronization
+    using Handler = std::function<std::string(ServerRequest const& request, std::size_t worker)>;
+
+    ConversionServer(std::filesystem::path socketPath, std::size_t workerCount, Handler handler);
+    ConversionServer(ConversionServer const&) = delete;
+    ConversionServer& operator=(ConversionServer const&) = delete;
+    ~ConversionServer();
+
+    bool Listen();
+
+    // serves connections until shutdown is requested, then finishes requests in progress and closes all connections
+    void Run();
+
+    std::size_t GetWorkerCount() const { return _workerCount; }
+
+private:
+    void ServeConnection(std::intptr_t connection, std::size_t worker);
+    void Stop();
+
+    std::filesystem::path _socketPath;
+    std::size_t _workerCount;
+    Handler _handler;
+    std::intptr_t _listener;
+    std::atomic<bool> _stopping = false;
+};
+
+#endif
@@ -0,0 +1,87 @@
+﻿#include "MappedFile.h"
+#include <utility>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _file(std::exchange(other._file, nullptr)), _mapping(std::exchange(other._mapping, nullptr)),
+    _view(std::exchange(other._view, nullptr)), _size(std::exchange(other._size, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        _file = std::exchange(other._file, nullptr);
+        _mapping = std::exchange(other._mapping, nullptr);
+        _view = std::exchange(other._view, nullptr);
+        _size = std::exchange(other._size, 0);
+    }
+
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(std::filesystem::path const& path)
+{
+    Close();
+
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    _file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        Close();
+        return false;
+    }
+
+    // empty files cannot be mapped
+    if (!size.QuadPart)
+        return true;
+
+    _mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!_mapping)
+    {
+        Close();
+        return false;
+    }
+
+    _view = static_cast<std::uint8_t const*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!_view)
+    {
+        Close();
+        return false;
+    }
+
+    _size = static_cast<std::size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (_view)
+        UnmapViewOfFile(_view);
+
+    if (_mapping)
+        CloseHandle(_mapping);
+
+    if (_file)
+        CloseHandle(_file);
+
+    _file = nullptr;
+    _mapping = nullptr;
+    _view = nullptr;
+    _size = 0;
+}
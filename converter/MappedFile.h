@@ -0,0 +1,33 @@
+﻿#ifndef WDB_TO_PKT_MAPPED_FILE_H
+#define WDB_TO_PKT_MAPPED_FILE_H
+
+#include <filesystem>
+#include <span>
+#include <cstdint>
+
+// Read-only memory mapping of an entire file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    bool Open(std::filesystem::path const& path);
+    void Close();
+
+    std::uint8_t const* data() const { return _view; }
+    std::size_t size() const { return _size; }
+    std::span<std::uint8_t const> span() const { return { _view, _size }; }
+
+private:
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+    std::uint8_t const* _view = nullptr;
+    std::size_t _size = 0;
+};
+
+#endif
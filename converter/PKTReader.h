@@ -0,0 +1,229 @@
+﻿#ifndef WDB_TO_PKT_PKT_READER_H
+#define WDB_TO_PKT_PKT_READER_H
+
+#include "ByteBuffer/ByteBuffer.h"
+#include <algorithm>
+#include <array>
+#include <expected>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <cstring>
+
+#pragma pack(push, 1)
+
+namespace PKT
+{
+    struct FileHeader
+    {
+        std::array<char, 3> Signature = { 'P', 'K', 'T' };
+        std::uint16_t FormatVersion = 0x301;
+        std::uint8_t SnifferId = 0;
+        std::uint32_t Build = 0;
+        std::array<char, 4> Locale = { };
+        std::array<std::uint8_t, 40> SessionKey = { };
+        std::uint32_t SniffStartUnixtime = 0;
+        std::uint32_t SniffStartTicks = 0;
+        std::uint32_t OptionalDataSize = 0;
+    };
+
+    struct PacketHeader
+    {
+        std::uint32_t Direction = 0x47534d53;
+        std::uint32_t ConnectionId = 0;
+        std::uint32_t ArrivalTicks = 0;
+        std::uint32_t OptionalDataSize = 0;
+        std::uint32_t Length = 0;
+    };
+
+    // entry of packet offset index written by verification
+    struct IndexEntry
+    {
+        std::uint64_t Offset = 0; // position of PacketHeader in file
+        std::int32_t Id = 0;
+        std::uint32_t Length = 0;
+    };
+
+    struct IndexHeader
+    {
+        std::array<char, 4> Signature = { 'P', 'K', 'T', 'I' };
+        std::uint32_t Version = 1;
+        std::uint64_t Count = 0;
+    };
+}
+
+#pragma pack(pop)
+
+template <>
+struct ByteBufferStructDescriptor<PKT::FileHeader> : ByteBufferFieldList<PKT::FileHeader,
+    BYTEBUFFER_FIELD(PKT::FileHeader, Signature),
+    BYTEBUFFER_FIELD(PKT::FileHeader, FormatVersion),
+    BYTEBUFFER_FIELD(PKT::FileHeader, SnifferId),
+    BYTEBUFFER_FIELD(PKT::FileHeader, Build),
+    BYTEBUFFER_FIELD(PKT::FileHeader, Locale),
+    BYTEBUFFER_FIELD(PKT::FileHeader, SessionKey),
+    BYTEBUFFER_FIELD(PKT::FileHeader, SniffStartUnixtime),
+    BYTEBUFFER_FIELD(PKT::FileHeader, SniffStartTicks),
+    BYTEBUFFER_FIELD(PKT::FileHeader, OptionalDataSize)>
+{
+};
+
+template <>
+struct ByteBufferStructDescriptor<PKT::PacketHeader> : ByteBufferFieldList<PKT::PacketHeader,
+    BYTEBUFFER_FIELD(PKT::PacketHeader, Direction),
+    BYTEBUFFER_FIELD(PKT::PacketHeader, ConnectionId),
+    BYTEBUFFER_FIELD(PKT::PacketHeader, ArrivalTicks),
+    BYTEBUFFER_FIELD(PKT::PacketHeader, OptionalDataSize),
+    BYTEBUFFER_FIELD(PKT::PacketHeader, Length)>
+{
+};
+
+template <>
+struct ByteBufferStructDescriptor<PKT::IndexEntry> : ByteBufferFieldList<PKT::IndexEntry,
+    BYTEBUFFER_FIELD(PKT::IndexEntry, Offset),
+    BYTEBUFFER_FIELD(PKT::IndexEntry, Id),
+    BYTEBUFFER_FIELD(PKT::IndexEntry, Length)>
+{
+};
+
+template <>
+struct ByteBufferStructDescriptor<PKT::IndexHeader> : ByteBufferFieldList<PKT::IndexHeader,
+    BYTEBUFFER_FIELD(PKT::IndexHeader, Signature),
+    BYTEBUFFER_FIELD(PKT::IndexHeader, Version),
+    BYTEBUFFER_FIELD(PKT::IndexHeader, Count)>
+{
+};
+
+// file formats have no padding, make sure pragma pack took effect
+static_assert(sizeof(PKT::FileHeader) == 66 && ByteBufferStructDescriptor<PKT::FileHeader>::IsTriviallySerializable);
+static_assert(sizeof(PKT::PacketHeader) == 20 && ByteBufferStructDescriptor<PKT::PacketHeader>::IsTriviallySerializable);
+static_assert(sizeof(PKT::IndexEntry) == 16 && ByteBufferStructDescriptor<PKT::IndexEntry>::IsContiguous);
+static_assert(sizeof(PKT::IndexHeader) == 16 && ByteBufferStructDescriptor<PKT::IndexHeader>::IsContiguous);
+static_assert(HasByteBufferShiftOperators<PKT::FileHeader> && HasByteBufferShiftOperators<PKT::PacketHeader>);
+static_assert(HasByteBufferShiftOperators<PKT::IndexHeader> && HasByteBufferShiftOperators<PKT::IndexEntry>);
+
+namespace PKT
+{
+    // Single packet pointing into file data, Data is shorter than Header.Length only for the last packet of a truncated file
+    struct PacketView
+    {
+        std::size_t Offset = 0; // position of PacketHeader in file
+        PacketHeader Header;
+        std::span<std::uint8_t const> Data;
+
+        bool IsComplete() const { return Data.size() == Header.Length; }
+    };
+
+    class PacketIterator
+    {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = PacketView;
+        using difference_type = std::ptrdiff_t;
+
+        PacketIterator() = default;
+        PacketIterator(std::span<std::uint8_t const> file, std::size_t pos) : _file(file), _pos(pos), _atEnd(false) { Advance(); }
+
+        PacketView const& operator*() const { return _current; }
+        PacketView const* operator->() const { return &_current; }
+
+        PacketIterator& operator++()
+        {
+            Advance();
+            return *this;
+        }
+
+        PacketIterator operator++(int)
+        {
+            PacketIterator itr = *this;
+            Advance();
+            return itr;
+        }
+
+        bool operator==(PacketIterator const& right) const { return _atEnd == right._atEnd && (_atEnd || _current.Offset == right._current.Offset); }
+        bool operator==(std::default_sentinel_t) const { return _atEnd; }
+
+        // position after last returned packet, equals file size for well formed files once iteration ends
+        std::size_t Position() const { return _pos; }
+
+    private:
+        void Advance()
+        {
+            if (_pos + sizeof(PacketHeader) > _file.size())
+            {
+                _atEnd = true;
+                return;
+            }
+
+            _current.Offset = _pos;
+            std::memcpy(&_current.Header, _file.data() + _pos, sizeof(PacketHeader));
+            _pos += sizeof(PacketHeader);
+
+            // packet optional data is not part of Length
+            std::size_t dataPos = std::min<std::size_t>(_pos + _current.Header.OptionalDataSize, _file.size());
+            std::size_t available = std::min<std::size_t>(_current.Header.Length, _file.size() - dataPos);
+            _current.Data = _file.subspan(dataPos, available);
+            _pos = dataPos + available;
+        }
+
+        std::span<std::uint8_t const> _file;
+        std::size_t _pos = 0;
+        PacketView _current;
+        bool _atEnd = true;
+    };
+
+    // Lazily parsed packets of a PKT file, does not copy any data
+    class PacketRange : public std::ranges::view_interface<PacketRange>
+    {
+    public:
+        PacketRange() = default;
+        PacketRange(std::span<std::uint8_t const> file, std::size_t firstPacket) : _file(file), _firstPacket(firstPacket) { }
+
+        PacketIterator begin() const { return PacketIterator(_file, _firstPacket); }
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    private:
+        std::span<std::uint8_t const> _file;
+        std::size_t _firstPacket = 0;
+    };
+
+    // Parses PKT file from in-memory or memory mapped data, which must outlive the reader and all packet views
+    class Reader
+    {
+    public:
+        explicit Reader(std::span<std::uint8_t const> file) : _file(file) { }
+
+        std::expected<FileHeader, ByteBufferPositionError> ReadHeader() const
+        {
+            constexpr std::size_t headerSize = ByteBufferStructDescriptor<FileHeader>::SerializedSize;
+            if (_file.size() < headerSize)
+                return std::unexpected(ByteBufferPositionError{ 0, _file.size(), headerSize });
+
+            // parsed through descriptor, layout changes of header only need updating its field list
+            ByteBuffer data(headerSize, ByteBuffer::Reserve{});
+            data.append(_file.data(), headerSize);
+
+            FileHeader header;
+            data >> header;
+            return header;
+        }
+
+        // header must be valid
+        PacketRange Packets(FileHeader const& header) const
+        {
+            return PacketRange(_file, std::min<std::size_t>(sizeof(FileHeader) + header.OptionalDataSize, _file.size()));
+        }
+
+    private:
+        std::span<std::uint8_t const> _file;
+    };
+}
+
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<PKT::PacketRange> = true;
+
+static_assert(std::forward_iterator<PKT::PacketIterator>);
+static_assert(std::ranges::view<PKT::PacketRange> && std::ranges::forward_range<PKT::PacketRange>);
+
+#endif
@@ -0,0 +1,78 @@
+﻿#include "Tracing.h"
+#include "ByteBuffer/ByteBuffer.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <TraceLoggingProvider.h>
+
+// {af9be6f3-5301-4a79-b85b-2b822d195c91}
+TRACELOGGING_DEFINE_PROVIDER(WDBtoPKTProvider, "WDBtoPKT", (0xaf9be6f3, 0x5301, 0x4a79, 0xb8, 0x5b, 0x2b, 0x82, 0x2d, 0x19, 0x5c, 0x91));
+
+namespace
+{
+void NTAPI OnProviderEnableChanged(LPCGUID /*sourceId*/, ULONG /*isEnabled*/, UCHAR /*level*/, ULONGLONG /*matchAnyKeyword*/,
+    ULONGLONG /*matchAllKeyword*/, PEVENT_FILTER_DESCRIPTOR /*filterData*/, PVOID /*callbackContext*/)
+{
+    // provider state already includes all sessions at this point
+    Trace::Enabled = TraceLoggingProviderEnabled(WDBtoPKTProvider, 0, 0);
+}
+
+void OnBufferReallocated(std::size_t oldCapacity, std::size_t newCapacity)
+{
+    WDB_TO_PKT_TRACE(BufferRealloc, oldCapacity, newCapacity);
+}
+}
+
+void Trace::Initialize()
+{
+    TraceLoggingRegisterEx(WDBtoPKTProvider, OnProviderEnableChanged, nullptr);
+
+#ifdef WDB_TO_PKT_TRACING
+    // vendored ByteBuffer does not depend on tracing, reallocations are reported through its hook
+    ByteBuffer::SetReallocationHook(OnBufferReallocated);
+#endif
+}
+
+void Trace::Shutdown()
+{
+    ByteBuffer::SetReallocationHook(nullptr);
+    Enabled = false;
+    TraceLoggingUnregister(WDBtoPKTProvider);
+}
+
+void Trace::FileOpen(char const* path, std::uint64_t size)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "FileOpen", TraceLoggingString(path, "Path"), TraceLoggingUInt64(size, "Size"));
+}
+
+void Trace::FileRead(char const* path, std::uint64_t size)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "FileRead", TraceLoggingString(path, "Path"), TraceLoggingUInt64(size, "Size"));
+}
+
+void Trace::HeaderParsed(std::uint32_t magic, std::uint32_t build, std::uint32_t recordVersion)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "HeaderParsed", TraceLoggingHexUInt32(magic, "Magic"), TraceLoggingUInt32(build, "Build"),
+        TraceLoggingUInt32(recordVersion, "RecordVersion"));
+}
+
+void Trace::RecordBegin(std::int32_t id, std::uint32_t size)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "RecordBegin", TraceLoggingInt32(id, "Id"), TraceLoggingUInt32(size, "Size"));
+}
+
+void Trace::RecordEnd(std::int32_t id, std::uint64_t packetSize)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "RecordEnd", TraceLoggingInt32(id, "Id"), TraceLoggingUInt64(packetSize, "PacketSize"));
+}
+
+void Trace::BufferRealloc(std::uint64_t oldCapacity, std::uint64_t newCapacity)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "BufferRealloc", TraceLoggingUInt64(oldCapacity, "OldCapacity"), TraceLoggingUInt64(newCapacity, "NewCapacity"));
+}
+
+void Trace::OutputFlush(char const* path, std::uint64_t size)
+{
+    TraceLoggingWrite(WDBtoPKTProvider, "OutputFlush", TraceLoggingString(path, "Path"), TraceLoggingUInt64(size, "Size"));
+}
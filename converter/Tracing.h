@@ -0,0 +1,32 @@
+﻿#ifndef WDB_TO_PKT_TRACING_H
+#define WDB_TO_PKT_TRACING_H
+
+#include <atomic>
+#include <cstdint>
+
+// Static tracepoints in conversion hot path
+// TraceLogging events of ETW provider "WDBtoPKT"
+// Tracepoint arguments are only evaluated while a trace session is listening
+namespace Trace
+{
+    inline std::atomic<bool> Enabled = false;
+
+    void Initialize();
+    void Shutdown();
+
+    void FileOpen(char const* path, std::uint64_t size);
+    void FileRead(char const* path, std::uint64_t size);
+    void HeaderParsed(std::uint32_t magic, std::uint32_t build, std::uint32_t recordVersion);
+    void RecordBegin(std::int32_t id, std::uint32_t size);
+    void RecordEnd(std::int32_t id, std::uint64_t packetSize);
+    void BufferRealloc(std::uint64_t oldCapacity, std::uint64_t newCapacity);
+    void OutputFlush(char const* path, std::uint64_t size);
+}
+
+#ifdef WDB_TO_PKT_TRACING
+#define WDB_TO_PKT_TRACE(event, ...) do { if (Trace::Enabled.load(std::memory_order_relaxed)) [[unlikely]] Trace::event(__VA_ARGS__); } while (0)
+#else
+#define WDB_TO_PKT_TRACE(event, ...) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,173 @@
+﻿#ifndef WDB_TO_PKT_WDB_READER_H
+#define WDB_TO_PKT_WDB_READER_H
+
+#include "ByteBuffer/ByteBuffer.h"
+#include <algorithm>
+#include <array>
+#include <expected>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <cstring>
+
+#pragma pack(push, 1)
+
+namespace WDB
+{
+    struct FileHeader
+    {
+        std::array<char, 4> Magic = { };
+        std::uint32_t Build = 0;
+        std::array<char, 4> Locale = { };
+        std::uint32_t RecordSize = 0;
+        std::uint32_t RecordVersion = 0;
+        std::uint32_t CacheVersion = 0;
+    };
+}
+
+#pragma pack(pop)
+
+template <>
+struct ByteBufferStructDescriptor<WDB::FileHeader> : ByteBufferFieldList<WDB::FileHeader,
+    BYTEBUFFER_FIELD(WDB::FileHeader, Magic),
+    BYTEBUFFER_FIELD(WDB::FileHeader, Build),
+    BYTEBUFFER_FIELD(WDB::FileHeader, Locale),
+    BYTEBUFFER_FIELD(WDB::FileHeader, RecordSize),
+    BYTEBUFFER_FIELD(WDB::FileHeader, RecordVersion),
+    BYTEBUFFER_FIELD(WDB::FileHeader, CacheVersion)>
+{
+};
+
+static_assert(sizeof(WDB::FileHeader) == 24 && ByteBufferStructDescriptor<WDB::FileHeader>::IsTriviallySerializable);
+static_assert(HasByteBufferShiftOperators<WDB::FileHeader>);
+
+namespace WDB
+{
+    // Single record pointing into file data, Data is shorter than Size only for the last record of a truncated file
+    // file cut inside id/size prefix ends with a record of Size 8 at Offset of the prefix, holding the leftover bytes
+    struct RecordView
+    {
+        std::int32_t Id = 0;
+        std::uint32_t Size = 0;
+        std::size_t Offset = 0; // position of record data in file
+        std::span<std::uint8_t const> Data;
+
+        bool IsComplete() const { return Data.size() == Size; }
+    };
+
+    class RecordIterator
+    {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = RecordView;
+        using difference_type = std::ptrdiff_t;
+
+        RecordIterator() = default;
+        RecordIterator(std::span<std::uint8_t const> file, std::size_t pos) : _file(file), _pos(pos), _atEnd(false) { Advance(); }
+
+        RecordView const& operator*() const { return _current; }
+        RecordView const* operator->() const { return &_current; }
+
+        RecordIterator& operator++()
+        {
+            Advance();
+            return *this;
+        }
+
+        RecordIterator operator++(int)
+        {
+            RecordIterator itr = *this;
+            Advance();
+            return itr;
+        }
+
+        bool operator==(RecordIterator const& right) const { return _atEnd == right._atEnd && (_atEnd || _current.Offset == right._current.Offset); }
+        bool operator==(std::default_sentinel_t) const { return _atEnd; }
+
+    private:
+        void Advance()
+        {
+            // records with size 0 are skipped, including the end marker in last 8 bytes of file
+            while (_pos < _file.size())
+            {
+                if (_file.size() - _pos < 8)
+                {
+                    // file is cut inside id/size prefix
+                    _current = { .Id = 0, .Size = 8, .Offset = _pos, .Data = _file.subspan(_pos) };
+                    _pos = _file.size();
+                    return;
+                }
+
+                std::int32_t id;
+                std::uint32_t size;
+                std::memcpy(&id, _file.data() + _pos, sizeof(id));
+                std::memcpy(&size, _file.data() + _pos + 4, sizeof(size));
+                _pos += 8;
+                if (!size)
+                    continue;
+
+                std::size_t available = std::min<std::size_t>(size, _file.size() - _pos);
+                _current = { .Id = id, .Size = size, .Offset = _pos, .Data = _file.subspan(_pos, available) };
+                _pos += available;
+                return;
+            }
+
+            _atEnd = true;
+        }
+
+        std::span<std::uint8_t const> _file;
+        std::size_t _pos = 0;
+        RecordView _current;
+        bool _atEnd = true;
+    };
+
+    // Lazily parsed records of a WDB file, does not copy any data
+    class RecordRange : public std::ranges::view_interface<RecordRange>
+    {
+    public:
+        RecordRange() = default;
+        explicit RecordRange(std::span<std::uint8_t const> file) : _file(file) { }
+
+        RecordIterator begin() const { return _file.size() > sizeof(FileHeader) ? RecordIterator(_file, sizeof(FileHeader)) : RecordIterator(); }
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    private:
+        std::span<std::uint8_t const> _file;
+    };
+
+    // Parses WDB file from in-memory or memory mapped data, which must outlive the reader and all record views
+    class Reader
+    {
+    public:
+        explicit Reader(std::span<std::uint8_t const> file) : _file(file) { }
+
+        std::expected<FileHeader, ByteBufferPositionError> ReadHeader() const
+        {
+            constexpr std::size_t headerSize = ByteBufferStructDescriptor<FileHeader>::SerializedSize;
+            if (_file.size() < headerSize)
+                return std::unexpected(ByteBufferPositionError{ 0, _file.size(), headerSize });
+
+            // parsed through descriptor, layout changes of header only need updating its field list
+            ByteBuffer data(headerSize, ByteBuffer::Reserve{});
+            data.append(_file.data(), headerSize);
+
+            FileHeader header;
+            data >> header;
+            return header;
+        }
+
+        RecordRange Records() const { return RecordRange(_file); }
+
+    private:
+        std::span<std::uint8_t const> _file;
+    };
+}
+
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<WDB::RecordRange> = true;
+
+static_assert(std::forward_iterator<WDB::RecordIterator>);
+static_assert(std::ranges::view<WDB::RecordRange> && std::ranges::forward_range<WDB::RecordRange>);
+
+#endif
@@ -1,79 +1,93 @@
 ﻿
 #include "ByteBuffer/ByteBuffer.h"
+#include "BuildCache.h"
+#include "ConversionScheduler.h"
+#include "ConversionServer.h"
+#include "MappedFile.h"
+#include "PKTReader.h"
+#include "Tracing.h"
+#include "WDBReader.h"
 #include <msclr/marshal_cppstd.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <expected>
 #include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <cstddef>
 #include <cstdio>
 
 using namespace std::string_literals;
 
-#pragma pack(push, 1)
+struct ConversionOptions
+{
+    std::size_t ShardSize = 0;      // maximum size of a single output file, 0 = unlimited
+    std::size_t ShardCount = 0;     // number of output files to split packets into, 0 = single file
+    bool Salvage = false;           // convert all complete records of truncated files instead of discarding them
+    std::size_t MemoryBudget = 0;   // maximum estimated memory of all concurrently converted files, 0 = unlimited
+    bool Force = false;             // convert inputs even if build cache says they are up to date
+    bool Verify = false;            // check existing output instead of converting
+    bool WriteIndex = false;        // write packet offset index of every verified PKT file
+    std::string ServerSocket;       // serve conversion requests on this local socket instead of converting inputs
+};
+
+// bump whenever converting the same input produces different output
+constexpr std::uint32_t ConverterVersion = 1;
 
-namespace WDB
+// converter version combined with all options affecting output
+std::string GetConverterVersionKey(ConversionOptions const& options)
 {
-    struct FileHeader
-    {
-        std::array<char, 4> Magic = { };
-        std::uint32_t Build = 0;
-        std::array<char, 4> Locale = { };
-        std::uint32_t RecordSize = 0;
-        std::uint32_t RecordVersion = 0;
-        std::uint32_t CacheVersion = 0;
-    };
+    return std::format("{};shard-size={};shards={};salvage={}", ConverterVersion, options.ShardSize, options.ShardCount, options.Salvage);
 }
 
-namespace PKT
+// state of a single file conversion, filled from WDB header
+struct ConversionContext
 {
-    struct FileHeader
-    {
-        std::array<char, 3> Signature = { 'P', 'K', 'T' };
-        std::uint16_t FormatVersion = 0x301;
-        std::uint8_t SnifferId = 0;
-        std::uint32_t Build = 0;
-        std::array<char, 4> Locale = { };
-        std::array<std::uint8_t, 40> SessionKey = { };
-        std::uint32_t SniffStartUnixtime = 0;
-        std::uint32_t SniffStartTicks = 0;
-        std::uint32_t OptionalDataSize = 0;
-    };
-
-    ByteBuffer& operator<<(ByteBuffer& data, FileHeader const& header)
-    {
-        data.append(header.Signature);
-        data << header.FormatVersion;
-        data << header.SnifferId;
-        data << header.Build;
-        data.append(header.Locale);
-        data.append(header.SessionKey);
-        data << header.SniffStartUnixtime;
-        data << header.SniffStartTicks;
-        data << header.OptionalDataSize;
+    explicit ConversionContext(ConversionOptions const& options) : Options(options) { }
 
-        return data;
-    }
+    ConversionOptions const& Options;
+    std::array<char, 4> Magic = { };
+    std::uint32_t Build = 0;
+    std::array<char, 4> Locale = { }; // PKT byte order
+    std::uint32_t Opcode = 0;
+};
 
-    struct PacketHeader
-    {
-        std::uint32_t Direction = 0x47534d53;
-        std::uint32_t ConnectionId = 0;
-        std::uint32_t ArrivalTicks = 0;
-        std::uint32_t OptionalDataSize = 0;
-        std::uint32_t Length = 0;
-    };
+struct WDBProcessResult
+{
+    std::size_t ProcessedRecords = 0;
+    std::optional<ByteBufferPositionError> Truncation; // only set in salvage mode
+};
 
-    ByteBuffer& operator<<(ByteBuffer& data, PacketHeader const& header)
-    {
-        data << header.Direction;
-        data << header.ConnectionId;
-        data << header.ArrivalTicks;
-        data << header.OptionalDataSize;
-        data << header.Length;
-        return data;
-    }
-}
+// location of a single converted record in output buffer
+struct PacketRecord
+{
+    std::int32_t Id = 0;
+    std::size_t Offset = 0; // position of PKT::PacketHeader
+    std::size_t Size = 0;   // PKT::PacketHeader + packet data
+};
 
-#pragma pack(pop)
+struct PKTShard
+{
+    std::size_t FirstPacket = 0;
+    std::size_t PacketCount = 0;
+    std::size_t Begin = 0;
+    std::size_t End = 0;
+};
 
 std::uint32_t GetOpcodeValueFromWPP(std::array<char, 4> wdbMagic)
 {
@@ -97,71 +111,886 @@ std::uint32_t GetOpcodeValueFromWPP(std::array<char, 4> wdbMagic)
     return Version::Opcodes::GetOpcode(opcode, Direction::ServerToClient);
 }
 
-void ProcessWDBRecord(ByteBuffer& wdb, std::array<char, 4> wdbMagic, std::uint32_t build, std::int32_t id, std::uint32_t recordSize, ByteBuffer& pkt)
+// WPP opcode tables depend on global client version, this resolves every (build, WDB type) pair once
+// and makes it safe to convert files from different builds at the same time
+class WPPOpcodeCache
 {
+public:
+    static std::uint32_t GetOpcode(std::array<char, 4> wdbMagic, std::uint32_t build)
+    {
+        std::uint64_t key = std::uint64_t(build) << 32 | std::bit_cast<std::uint32_t>(wdbMagic);
+
+        {
+            std::shared_lock lock(_lock);
+            auto itr = _opcodes.find(key);
+            if (itr != _opcodes.end())
+                return itr->second;
+        }
+
+        std::unique_lock lock(_lock);
+        auto itr = _opcodes.find(key);
+        if (itr != _opcodes.end())
+            return itr->second;
+
+        WowPacketParser::Misc::ClientVersion::SetVersion(WowPacketParser::Enums::ClientVersionBuild(build));
+        std::uint32_t opcode = GetOpcodeValueFromWPP(wdbMagic);
+        _opcodes.emplace(key, opcode);
+        return opcode;
+    }
+
+private:
+    static std::shared_mutex _lock;
+    static std::unordered_map<std::uint64_t, std::uint32_t> _opcodes;
+};
+
+std::shared_mutex WPPOpcodeCache::_lock;
+std::unordered_map<std::uint64_t, std::uint32_t> WPPOpcodeCache::_opcodes;
+
+// size of data added around each WDB record
+std::size_t GetPacketWrapperSize(std::array<char, 4> wdbMagic)
+{
+    std::size_t size = sizeof(PKT::PacketHeader) + 4 + 4 + 1; // header + opcode + id + bit
+    if (wdbMagic == std::array{ 'B', 'O', 'G', 'W' })
+        size += 2 + 4; // guid mask + data size
+    else if (wdbMagic == std::array{ 'C', 'P', 'N', 'W' } || wdbMagic == std::array{ 'X', 'T', 'P', 'W' })
+        size += 4; // data size/page count
+
+    return size;
+}
+
+PacketRecord ProcessWDBRecord(ConversionContext const& context, std::span<std::uint8_t const> record, std::int32_t id, ByteBuffer& pkt)
+{
+    std::array<char, 4> const& wdbMagic = context.Magic;
+
+    WDB_TO_PKT_TRACE(RecordBegin, id, static_cast<std::uint32_t>(record.size()));
+
     PKT::PacketHeader header;
 
     // create a wrapper packet
-    std::size_t headerPos = pkt.wpos();
+    ByteBuffer::WriteCursor cursor = pkt.BeginWrite(GetPacketWrapperSize(wdbMagic) + record.size());
 
-    pkt << header;
+    std::size_t headerPos = cursor.wpos();
 
-    std::size_t pktPos = pkt.wpos();
+    cursor.append(header);
 
-    pkt.append<std::uint32_t>(GetOpcodeValueFromWPP(wdbMagic));
+    std::size_t pktPos = cursor.wpos();
 
-    pkt.append<std::int32_t>(id);
+    cursor.append<std::uint32_t>(context.Opcode);
+
+    cursor.append<std::int32_t>(id);
     if (wdbMagic == std::array{ 'B', 'O', 'G', 'W' })
-        pkt.append<std::uint16_t>(0); // empty guid mask
+        cursor.append<std::uint16_t>(0); // empty guid mask
 
-    pkt.WriteBit(true);
-    pkt.FlushBits();
+    cursor.append<std::uint8_t>(0x80); // single bit set to true, flushed
 
     if (wdbMagic == std::array{ 'B', 'O', 'G', 'W' })
-        pkt.append<std::uint32_t>(1); // data size - doesnt actually matter to fill it properly, WPP is only checking != 0
+        cursor.append<std::uint32_t>(1); // data size - doesnt actually matter to fill it properly, WPP is only checking != 0
     else if (wdbMagic == std::array{ 'C', 'P', 'N', 'W' })
-        pkt.append<std::uint32_t>(64); // data size
+        cursor.append<std::uint32_t>(64); // data size
     else if (wdbMagic == std::array{ 'X', 'T', 'P', 'W' })
-        pkt.append<std::uint32_t>(1); // page count
+        cursor.append<std::uint32_t>(1); // page count
+
+    cursor.append(record.data(), record.size());
 
-    pkt.append(wdb.data() + wdb.rpos(), recordSize);
-    wdb.rpos(wdb.rpos() + recordSize);
+    cursor.put<std::uint32_t>(headerPos + offsetof(PKT::PacketHeader, Length), static_cast<std::uint32_t>(cursor.wpos() - pktPos));
 
-    reinterpret_cast<PKT::PacketHeader*>(pkt.data() + headerPos)->Length = static_cast<std::uint32_t>(pkt.wpos() - pktPos);
+    pkt.EndWrite(cursor);
+
+    WDB_TO_PKT_TRACE(RecordEnd, id, pkt.wpos() - headerPos);
+
+    return { .Id = id, .Offset = headerPos, .Size = pkt.wpos() - headerPos };
+}
+
+void InitializeContext(ConversionContext& context, WDB::FileHeader const& header)
+{
+    context.Magic = header.Magic;
+    context.Build = header.Build;
+    std::reverse_copy(header.Locale.begin(), header.Locale.end(), context.Locale.begin());
+    context.Opcode = WPPOpcodeCache::GetOpcode(header.Magic, header.Build);
 }
 
-std::size_t ProcessWDB(ByteBuffer& wdb, ByteBuffer& pkt)
+WDBProcessResult ProcessWDB(ConversionContext& context, std::span<std::uint8_t const> wdb, ByteBuffer& pkt, std::vector<PacketRecord>& packets)
 {
-    WDB::FileHeader header;
-    wdb.read(header.Magic.data(), header.Magic.size());
-    wdb >> header.Build;
-    wdb.read(header.Locale.data(), header.Locale.size());
-    wdb >> header.RecordSize;
-    wdb >> header.RecordVersion;
-    wdb >> header.CacheVersion;
+    WDBProcessResult result;
 
-    WowPacketParser::Misc::ClientVersion::SetVersion(WowPacketParser::Enums::ClientVersionBuild(header.Build));
+    WDB::Reader reader(wdb);
+    std::expected<WDB::FileHeader, ByteBufferPositionError> header = reader.ReadHeader();
+    if (!header)
+    {
+        if (!context.Options.Salvage)
+            throw ByteBufferPositionException(header.error());
+
+        result.Truncation = header.error();
+        return result;
+    }
+
+    WDB_TO_PKT_TRACE(HeaderParsed, std::bit_cast<std::uint32_t>(header->Magic), header->Build, header->RecordVersion);
+
+    InitializeContext(context, *header);
 
     PKT::FileHeader pktHeader;
-    pktHeader.Build = header.Build;
-    std::reverse_copy(header.Locale.begin(), header.Locale.end(), pktHeader.Locale.begin());
+    pktHeader.Build = context.Build;
+    pktHeader.Locale = context.Locale;
 
     pkt << pktHeader;
 
-    std::size_t processedRecords = 0;
+    for (WDB::RecordView const& record : reader.Records())
+    {
+        if (!record.IsComplete())
+        {
+            ByteBufferPositionError error{ record.Offset, wdb.size(), record.Size };
+            if (!context.Options.Salvage)
+                throw ByteBufferPositionException(error);
+
+            result.Truncation = error;
+            break;
+        }
+
+        packets.push_back(ProcessWDBRecord(context, record.Data, record.Id, pkt));
+        ++result.ProcessedRecords;
+    }
+
+    return result;
+}
+
+// memory needed for mapped input, output buffer and packet list of a single file
+// record count is not known before reading the file, assume all records are as small as the smallest cache type (npc text)
+std::size_t EstimateConversionMemory(std::size_t fileSize, std::array<char, 4> wdbMagic)
+{
+    constexpr std::size_t MinExpectedRecordSize = 8 + 64; // id + size + npc text data
+    std::size_t records = fileSize / MinExpectedRecordSize + 1;
+    std::size_t outputSize = sizeof(PKT::FileHeader) + fileSize + records * (GetPacketWrapperSize(wdbMagic) - 8);
+
+    // output buffer may be reallocated once more at the end
+    return fileSize + outputSize * 3 / 2 + records * sizeof(PacketRecord);
+}
+
+// splits packets into contiguous groups, breaking only at packet boundaries
+std::vector<PKTShard> PlanShards(std::vector<PacketRecord> const& packets, ConversionOptions const& options)
+{
+    std::vector<PKTShard> shards;
+    if (packets.empty())
+        return shards;
+
+    std::size_t const dataBegin = packets.front().Offset;
+    std::size_t const dataSize = packets.back().Offset + packets.back().Size - dataBegin;
+
+    auto addPacket = [&](std::size_t index, bool startNewShard)
+    {
+        if (startNewShard || shards.empty())
+            shards.push_back({ .FirstPacket = index, .PacketCount = 0, .Begin = packets[index].Offset, .End = packets[index].Offset });
+
+        ++shards.back().PacketCount;
+        shards.back().End = packets[index].Offset + packets[index].Size;
+    };
+
+    // no shard can be empty
+    std::size_t const shardCount = std::min(options.ShardCount, packets.size());
+    if (shardCount > 1)
+    {
+        // assign each packet to the shard its starting offset falls into, this never produces more than shardCount files
+        // dividing by shard size rounded up instead of multiplying offset by shard count can't overflow
+        std::size_t const shardSize = dataSize / shardCount + (dataSize % shardCount != 0);
+        std::size_t currentShard = 0;
+        for (std::size_t i = 0; i < packets.size(); ++i)
+        {
+            std::size_t shard = (packets[i].Offset - dataBegin) / shardSize;
+            addPacket(i, shard != currentShard);
+            currentShard = shard;
+        }
+    }
+    else if (options.ShardSize > sizeof(PKT::FileHeader))
+    {
+        // each shard contains at least one packet even if it alone exceeds the limit
+        std::size_t const limit = options.ShardSize - sizeof(PKT::FileHeader);
+        for (std::size_t i = 0; i < packets.size(); ++i)
+            addPacket(i, !shards.empty() && shards.back().End - shards.back().Begin + packets[i].Size > limit);
+    }
+    else
+        shards.push_back({ .FirstPacket = 0, .PacketCount = packets.size(), .Begin = dataBegin, .End = dataBegin + dataSize });
+
+    return shards;
+}
+
+bool WriteFile(std::filesystem::path const& path, std::span<std::uint8_t const> header, std::span<std::uint8_t const> data)
+{
+    FILE* out = nullptr;
+    if (fopen_s(&out, path.string().c_str(), "wb") || !out)
+        return false;
+
+    bool success = fwrite(header.data(), header.size(), 1, out) == 1
+        && (data.empty() || fwrite(data.data(), data.size(), 1, out) == 1);
+    fclose(out);
+
+    WDB_TO_PKT_TRACE(OutputFlush, path.string().c_str(), header.size() + data.size());
+    return success;
+}
+
+// PKT files listed in manifest of sharded output, empty if there is none
+std::vector<std::filesystem::path> ReadManifest(std::filesystem::path const& manifestPath)
+{
+    std::vector<std::filesystem::path> files;
+    std::ifstream manifest(manifestPath);
+    std::string line;
+    while (std::getline(manifest, line))
+        if (!line.empty() && line[0] != '#')
+            files.push_back(manifestPath.parent_path() / line.substr(0, line.find('\t')));
+
+    return files;
+}
+
+// removes outputs (and their indexes) of previous conversion with different sharding that were not overwritten,
+// otherwise a stale manifest or shard would be picked up as part of the new output
+void RemoveStaleOutputs(std::filesystem::path const& inPath, std::vector<std::filesystem::path> stale, std::vector<std::filesystem::path> const& outputs)
+{
+    std::filesystem::path outPath = inPath;
+    stale.push_back(outPath.replace_extension("pkt"));
+    stale.push_back(outPath.replace_extension("manifest"));
+
+    std::error_code error;
+    for (std::filesystem::path& path : stale)
+    {
+        if (std::ranges::find(outputs, path) != outputs.end())
+            continue;
+
+        std::filesystem::remove(path, error);
+        std::filesystem::remove(path += ".idx", error);
+    }
+}
+
+// returns false if any file could not be written, outputs receives all files that were written
+// always called from a conversion worker, so shards are written on the calling thread instead of starting more threads per file
+bool WritePKT(std::filesystem::path const& inPath, ByteBuffer const& pkt, std::vector<PacketRecord> const& packets, ConversionOptions const& options,
+    std::vector<std::filesystem::path>& outputs)
+{
+    std::filesystem::path outPath = inPath;
+    outPath.replace_extension("pkt");
+
+    std::filesystem::path manifestPath = inPath;
+    manifestPath.replace_extension("manifest");
+
+    // must be read before it is overwritten
+    std::vector<std::filesystem::path> previousShards = ReadManifest(manifestPath);
+
+    std::span<std::uint8_t const> header(pkt.data(), sizeof(PKT::FileHeader));
+    std::vector<PKTShard> shards = PlanShards(packets, options);
+    if (shards.size() == 1)
+    {
+        if (!WriteFile(outPath, header, std::span(pkt.data() + shards[0].Begin, shards[0].End - shards[0].Begin)))
+        {
+            printf("Failed to write %s\n", outPath.filename().string().c_str());
+            return false;
+        }
+
+        outputs.push_back(outPath);
+        RemoveStaleOutputs(inPath, std::move(previousShards), outputs);
+        return true;
+    }
+
+    FILE* manifest = nullptr;
+    if (fopen_s(&manifest, manifestPath.string().c_str(), "w") || !manifest)
+        return false;
 
-    while (wdb.rpos() + 8 < wdb.size())
+    bool success = true;
+    fprintf(manifest, "# file\tfirst_id\tlast_id\tpackets\tbytes\n");
+    for (std::size_t i = 0; i < shards.size(); ++i)
     {
-        std::int32_t id = wdb.read<std::int32_t>();
-        std::uint32_t recordSize = wdb.read<std::uint32_t>();
-        if (!recordSize)
+        // every shard is a complete PKT file
+        std::filesystem::path shardPath = inPath;
+        shardPath.replace_extension(std::to_string(i) + ".pkt");
+        if (!WriteFile(shardPath, header, std::span(pkt.data() + shards[i].Begin, shards[i].End - shards[i].Begin)))
+        {
+            printf("Failed to write %s\n", shardPath.filename().string().c_str());
+            success = false;
             continue;
+        }
 
-        ProcessWDBRecord(wdb, header.Magic, header.Build, id, recordSize, pkt);
-        ++processedRecords;
+        outputs.push_back(shardPath);
+        fprintf(manifest, "%s\t%d\t%d\t%zu\t%zu\n", shardPath.filename().string().c_str(),
+            packets[shards[i].FirstPacket].Id, packets[shards[i].FirstPacket + shards[i].PacketCount - 1].Id,
+            shards[i].PacketCount, sizeof(PKT::FileHeader) + shards[i].End - shards[i].Begin);
     }
 
-    return processedRecords;
+    fclose(manifest);
+    outputs.push_back(manifestPath);
+    RemoveStaleOutputs(inPath, std::move(previousShards), outputs);
+    return success;
+}
+
+// accepts plain byte counts and K/M/G suffixes
+std::optional<std::size_t> ParseSize(std::string_view value)
+{
+    std::size_t result = 0;
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc() || end == value.data())
+        return {};
+
+    int shift;
+    std::string_view suffix(end, value.data() + value.size());
+    if (suffix.empty() || suffix == "B")
+        shift = 0;
+    else if (suffix == "K" || suffix == "KB")
+        shift = 10;
+    else if (suffix == "M" || suffix == "MB")
+        shift = 20;
+    else if (suffix == "G" || suffix == "GB")
+        shift = 30;
+    else
+        return {};
+
+    // value that does not fit is rejected instead of wrapping around
+    if (result > std::numeric_limits<std::size_t>::max() >> shift)
+        return {};
+
+    return result << shift;
+}
+
+// returns false if any option was invalid
+bool ParseArguments(std::vector<std::string> const& args, ConversionOptions& options, std::vector<std::string>& inputs)
+{
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        std::string_view arg = args[i];
+        if (!arg.starts_with("--"))
+        {
+            inputs.push_back(args[i]);
+            continue;
+        }
+
+        if (arg == "--salvage")
+        {
+            options.Salvage = true;
+            continue;
+        }
+
+        if (arg == "--force")
+        {
+            options.Force = true;
+            continue;
+        }
+
+        if (arg == "--verify")
+        {
+            options.Verify = true;
+            continue;
+        }
+
+        if (arg == "--write-index")
+        {
+            options.WriteIndex = true;
+            continue;
+        }
+
+        std::string const& option = args[i];
+        if (arg != "--server" && arg != "--shard-size" && arg != "--shards" && arg != "--memory-budget")
+        {
+            printf("Unknown option %s\n", option.c_str());
+            return false;
+        }
+
+        // all remaining options take a value
+        if (i + 1 >= args.size())
+        {
+            printf("Missing value for option %s\n", option.c_str());
+            return false;
+        }
+
+        std::string const& valueArg = args[++i];
+        if (arg == "--server")
+        {
+            options.ServerSocket = valueArg;
+            continue;
+        }
+
+        std::optional<std::size_t> value = ParseSize(valueArg);
+        if (!value)
+        {
+            printf("Invalid value for option %s\n", option.c_str());
+            return false;
+        }
+
+        if (arg == "--shard-size")
+            options.ShardSize = *value;
+        else if (arg == "--shards")
+            options.ShardCount = *value;
+        else
+            options.MemoryBudget = *value;
+    }
+
+    if (options.ShardSize && options.ShardCount)
+    {
+        printf("--shard-size and --shards cannot be used together\n");
+        return false;
+    }
+
+    if (options.WriteIndex && !options.Verify)
+    {
+        printf("--write-index can only be used with --verify\n");
+        return false;
+    }
+
+    if (!options.ServerSocket.empty() && (options.Verify || !inputs.empty()))
+    {
+        printf("--server does not take inputs, they are sent over the socket\n");
+        return false;
+    }
+
+    return true;
+}
+
+// output buffers reused by consecutive conversions of the same thread
+struct ConversionBuffers
+{
+    ByteBuffer PKT;
+    std::vector<PacketRecord> Packets;
+};
+
+struct ConversionStats
+{
+    WDBProcessResult Result;
+    std::size_t OutputBytes = 0;
+    std::size_t OutputFiles = 0;
+};
+
+// converts WDB data of inPath and writes output next to it
+ConversionStats ConvertData(std::filesystem::path const& inPath, std::span<std::uint8_t const> data, ConversionOptions const& options,
+    ConversionBuffers& buffers, std::vector<std::filesystem::path>& outputs)
+{
+    buffers.PKT.clear();
+    buffers.Packets.clear();
+
+    ConversionStats stats;
+    ConversionContext context(options);
+    stats.Result = ProcessWDB(context, data, buffers.PKT, buffers.Packets);
+    if (stats.Result.ProcessedRecords > 0)
+    {
+        if (!WritePKT(inPath, buffers.PKT, buffers.Packets, options, outputs))
+            throw std::runtime_error("failed to write output");
+
+        stats.OutputBytes = buffers.PKT.size();
+        stats.OutputFiles = outputs.size();
+    }
+
+    return stats;
+}
+
+void ConvertFile(std::filesystem::path const& inPath, ConversionOptions const& options, BuildCache& cache)
+{
+    // runs on scheduler workers, nothing may escape
+    try
+    {
+        // taken before reading, a file rewritten during conversion must not look up to date
+        std::optional<BuildCacheFileState> state = BuildCache::GetFileState(inPath);
+        if (!state)
+        {
+            printf("Failed to read %s\n", inPath.filename().string().c_str());
+            return;
+        }
+
+        WDB_TO_PKT_TRACE(FileOpen, inPath.string().c_str(), state->Size);
+
+        // records are converted straight from mapped file
+        MappedFile data;
+        if (!data.Open(inPath))
+        {
+            printf("Failed to open %s\n", inPath.filename().string().c_str());
+            return;
+        }
+
+        WDB_TO_PKT_TRACE(FileRead, inPath.string().c_str(), data.size());
+
+        std::uint64_t hash = BuildCache::Hash(data.span());
+
+        ConversionBuffers buffers;
+        std::vector<std::filesystem::path> outputs;
+        ConversionStats stats = ConvertData(inPath, data.span(), options, buffers, outputs);
+        if (stats.Result.Truncation)
+            printf("%s is truncated at offset %zu (%zu bytes needed, file size %zu), converted %zu complete records\n", inPath.filename().string().c_str(),
+                stats.Result.Truncation->Pos, stats.Result.Truncation->ValueSize, stats.Result.Truncation->Size, stats.Result.ProcessedRecords);
+
+        cache.Update(inPath, *state, hash, outputs);
+    }
+    catch (std::exception const& ex)
+    {
+        printf("Caught exception when processing %s: %s\n", inPath.filename().string().c_str(), ex.what());
+    }
+}
+
+std::vector<ConversionJob> CreateConversionJobs(std::vector<std::filesystem::path> const& inputs)
+{
+    std::vector<ConversionJob> jobs;
+    jobs.reserve(inputs.size());
+    for (std::filesystem::path const& inPath : inputs)
+    {
+        FILE* inFile = nullptr;
+        if (fopen_s(&inFile, inPath.string().c_str(), "rb") || !inFile)
+            continue;
+
+        std::array<char, 4> magic = { };
+        fread(magic.data(), magic.size(), 1, inFile);
+        fclose(inFile);
+
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(inPath, error);
+        if (error)
+            continue;
+
+        jobs.push_back({ .Path = inPath, .EstimatedMemory = EstimateConversionMemory(size, magic) });
+    }
+
+    return jobs;
+}
+
+void ConvertFiles(std::vector<std::string> const& inputs, ConversionOptions const& options)
+{
+    std::vector<std::filesystem::path> paths(inputs.begin(), inputs.end());
+
+    BuildCache cache(GetConverterVersionKey(options));
+    cache.Load(paths);
+
+    if (!options.Force)
+    {
+        std::size_t inputCount = paths.size();
+        paths = cache.FilterUpToDate(paths);
+        if (paths.size() < inputCount)
+            printf("Skipped %zu unchanged files\n", inputCount - paths.size());
+    }
+
+    ConversionScheduler scheduler(options.MemoryBudget, std::thread::hardware_concurrency());
+    scheduler.Run(CreateConversionJobs(paths), [&](ConversionJob const& job)
+    {
+        ConvertFile(job.Path, options, cache);
+    });
+
+    cache.Save();
+
+    if (options.MemoryBudget)
+        printf("Peak tracked memory: %zu MB\n", scheduler.GetPeakMemory() >> 20);
+}
+
+// checks a single PKT file, when context is set packets are also compared against source WDB records
+// records iterator is shared by all shards of the same WDB
+bool VerifyPKTFile(std::filesystem::path const& path, ConversionOptions const& options, ConversionContext const* context,
+    WDB::RecordIterator* records, std::size_t& packetCount, std::string& error)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        error = std::format("cannot open {}", path.filename().string());
+        return false;
+    }
+
+    PKT::Reader reader(file.span());
+    std::expected<PKT::FileHeader, ByteBufferPositionError> header = reader.ReadHeader();
+    if (!header)
+    {
+        error = std::format("{} is too short for PKT header", path.filename().string());
+        return false;
+    }
+
+    if (header->Signature != PKT::FileHeader().Signature || header->FormatVersion != PKT::FileHeader().FormatVersion)
+    {
+        error = std::format("{} is not a PKT {:#x} file", path.filename().string(), PKT::FileHeader().FormatVersion);
+        return false;
+    }
+
+    if (context && (header->Build != context->Build || header->Locale != context->Locale))
+    {
+        error = std::format("{} build or locale does not match WDB", path.filename().string());
+        return false;
+    }
+
+    std::size_t const wrapperSize = context ? GetPacketWrapperSize(context->Magic) - sizeof(PKT::PacketHeader) : 0;
+    std::vector<PKT::IndexEntry> index;
+
+    PKT::PacketRange packets = reader.Packets(*header);
+    PKT::PacketIterator itr = packets.begin();
+    for (; itr != packets.end(); ++itr)
+    {
+        PKT::PacketView const& packet = *itr;
+        auto fail = [&](std::string_view reason)
+        {
+            error = std::format("{} packet at offset {}: {}", path.filename().string(), packet.Offset, reason);
+            return false;
+        };
+
+        if (!packet.IsComplete())
+            return fail("truncated");
+
+        if (packet.Header.Direction != PKT::PacketHeader().Direction && packet.Header.Direction != 0x47534d43)
+            return fail("invalid direction");
+
+        if (packet.Header.Length < 8)
+            return fail("too short");
+
+        std::uint32_t opcode;
+        std::int32_t id;
+        std::memcpy(&opcode, packet.Data.data(), sizeof(opcode));
+        std::memcpy(&id, packet.Data.data() + 4, sizeof(id));
+
+        if (context)
+        {
+            // truncated record was not converted
+            if (*records == std::default_sentinel || !(*records)->IsComplete())
+                return fail("more packets than WDB records");
+
+            WDB::RecordView const& record = **records;
+            if (opcode != context->Opcode)
+                return fail("unexpected opcode");
+
+            if (id != record.Id)
+                return fail(std::format("id {} does not match WDB record {}", id, record.Id));
+
+            if (packet.Header.Length != wrapperSize + record.Size || !std::ranges::equal(packet.Data.last(record.Size), record.Data))
+                return fail(std::format("data does not match WDB record {}", record.Id));
+
+            ++*records;
+        }
+
+        index.push_back({ .Offset = packet.Offset, .Id = id, .Length = packet.Header.Length });
+    }
+
+    if (itr.Position() != file.size())
+    {
+        error = std::format("{} has {} trailing bytes", path.filename().string(), file.size() - itr.Position());
+        return false;
+    }
+
+    packetCount += index.size();
+
+    if (!options.WriteIndex)
+        return true;
+
+    PKT::IndexHeader indexHeader;
+    indexHeader.Count = index.size();
+
+    ByteBuffer indexData(ByteBufferStructDescriptor<PKT::IndexHeader>::SerializedSize
+        + index.size() * ByteBufferStructDescriptor<PKT::IndexEntry>::SerializedSize, ByteBuffer::Reserve{});
+    indexData << indexHeader;
+    for (PKT::IndexEntry const& entry : index)
+        indexData << entry;
+
+    std::filesystem::path indexPath = path;
+    indexPath += ".idx";
+    if (!WriteFile(indexPath, std::span(indexData.data(), indexData.size()), {}))
+    {
+        error = std::format("cannot write {}", indexPath.filename().string());
+        return false;
+    }
+
+    return true;
+}
+
+// returns PKT files that conversion of inPath with given options produces, sharded output is listed in manifest
+std::vector<std::filesystem::path> GetPKTFiles(std::filesystem::path const& inPath, ConversionOptions const& options)
+{
+    std::vector<std::filesystem::path> files;
+    std::filesystem::path outPath = inPath;
+    if (!options.ShardSize && !options.ShardCount)
+    {
+        outPath.replace_extension("pkt");
+        files.push_back(outPath);
+        return files;
+    }
+
+    outPath.replace_extension("manifest");
+    files = ReadManifest(outPath);
+
+    // single packet shards are written without manifest
+    if (files.empty())
+    {
+        outPath.replace_extension("pkt");
+        files.push_back(outPath);
+    }
+
+    return files;
+}
+
+// compares WDB records with packets of all PKT files converted from it
+bool VerifyWDBFile(std::filesystem::path const& inPath, ConversionOptions const& options, std::size_t& packetCount, std::string& error)
+{
+    MappedFile wdb;
+    if (!wdb.Open(inPath))
+    {
+        error = "cannot open WDB";
+        return false;
+    }
+
+    WDB::Reader reader(wdb.span());
+    std::expected<WDB::FileHeader, ByteBufferPositionError> header = reader.ReadHeader();
+    if (!header)
+    {
+        error = "WDB is too short for header";
+        return false;
+    }
+
+    ConversionContext context(options);
+    InitializeContext(context, *header);
+
+    WDB::RecordRange records = reader.Records();
+    WDB::RecordIterator record = records.begin();
+
+    // WDB without complete records is not converted at all
+    std::vector<std::filesystem::path> pktFiles = GetPKTFiles(inPath, options);
+    if (record == records.end() || !record->IsComplete())
+        if (!std::filesystem::exists(pktFiles.front()))
+            return true;
+
+    for (std::filesystem::path const& pktFile : pktFiles)
+        if (!VerifyPKTFile(pktFile, options, &context, &record, packetCount, error))
+            return false;
+
+    if (record != records.end() && record->IsComplete())
+    {
+        error = std::format("WDB record {} is missing from PKT", record->Id);
+        return false;
+    }
+
+    return true;
+}
+
+bool VerifyFile(std::filesystem::path const& inPath, ConversionOptions const& options)
+{
+    std::string error;
+    std::size_t packetCount = 0;
+    bool success = false;
+
+    try
+    {
+        if (inPath.extension() == ".pkt")
+            success = VerifyPKTFile(inPath, options, nullptr, nullptr, packetCount, error);
+        else
+            success = VerifyWDBFile(inPath, options, packetCount, error);
+    }
+    catch (std::exception const& ex)
+    {
+        error = ex.what();
+    }
+
+    if (success)
+        printf("OK %s: %zu packets\n", inPath.filename().string().c_str(), packetCount);
+    else
+        printf("FAILED %s: %s\n", inPath.filename().string().c_str(), error.c_str());
+
+    return success;
+}
+
+bool VerifyFiles(std::vector<std::string> const& inputs, ConversionOptions const& options)
+{
+    std::vector<ConversionJob> jobs;
+    for (std::string const& input : inputs)
+        jobs.push_back({ .Path = input, .EstimatedMemory = 0 }); // everything is memory mapped
+
+    std::atomic<std::size_t> failed = 0;
+    ConversionScheduler scheduler(0, std::thread::hardware_concurrency());
+    scheduler.Run(jobs, [&](ConversionJob const& job)
+    {
+        if (!VerifyFile(job.Path, options))
+            ++failed;
+    });
+
+    printf("Verified %zu files, %zu failed\n", jobs.size(), failed.load());
+    return !failed;
+}
+
+// answers a single server request with OK <records> <output bytes> <output files> <microseconds> [<truncation offset>] or ERROR <reason>
+// outputs of a file (.pkt, shards, manifest, index) share its path without extension,
+// a request for a file already being converted by another connection is rejected instead of writing the same outputs
+class ServerOutputLock
+{
+public:
+    explicit ServerOutputLock(std::filesystem::path const& inPath)
+        : _key(std::filesystem::absolute(inPath).lexically_normal().replace_extension().string())
+    {
+        std::lock_guard lock(_lock);
+        _acquired = _inFlight.insert(_key).second;
+    }
+
+    ServerOutputLock(ServerOutputLock const&) = delete;
+    ServerOutputLock& operator=(ServerOutputLock const&) = delete;
+
+    ~ServerOutputLock()
+    {
+        if (!_acquired)
+            return;
+
+        std::lock_guard lock(_lock);
+        _inFlight.erase(_key);
+    }
+
+    bool IsAcquired() const { return _acquired; }
+
+private:
+    std::string _key;
+    bool _acquired;
+
+    static std::mutex _lock;
+    static std::unordered_set<std::string> _inFlight;
+};
+
+std::mutex ServerOutputLock::_lock;
+std::unordered_set<std::string> ServerOutputLock::_inFlight;
+
+std::string HandleServerRequest(ServerRequest const& request, ConversionBuffers& buffers)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // runs on server workers, nothing may escape
+    try
+    {
+        ConversionOptions options;
+        std::vector<std::string> inputs;
+        if (!ParseArguments(request.Arguments, options, inputs) || !options.ServerSocket.empty() || options.Verify)
+            return "ERROR\tinvalid arguments";
+
+        if (inputs.size() != 1)
+            return "ERROR\texpected a single input path";
+
+        std::filesystem::path inPath = inputs.front();
+        ServerOutputLock outputLock(inPath);
+        if (!outputLock.IsAcquired())
+            return std::format("ERROR\t{} is already being converted", inPath.string());
+
+        MappedFile file;
+        std::span<std::uint8_t const> data;
+        if (request.Data)
+            data = *request.Data;
+        else if (file.Open(inPath))
+            data = file.span();
+        else
+            return std::format("ERROR\tcannot open {}", inPath.string());
+
+        std::vector<std::filesystem::path> outputs;
+        ConversionStats stats = ConvertData(inPath, data, options, buffers, outputs);
+
+        std::chrono::microseconds elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::string response = std::format("OK\t{}\t{}\t{}\t{}", stats.Result.ProcessedRecords, stats.OutputBytes, stats.OutputFiles, elapsed.count());
+        if (stats.Result.Truncation)
+            response += std::format("\t{}", stats.Result.Truncation->Pos);
+
+        return response;
+    }
+    catch (std::exception const& ex)
+    {
+        return std::format("ERROR\t{}", ex.what());
+    }
+}
+
+bool RunServer(ConversionOptions const& options)
+{
+    // every worker keeps its buffers, WPP opcodes are cached for the whole process
+    std::vector<ConversionBuffers> buffers(std::max(std::thread::hardware_concurrency(), 1u));
+    ConversionServer server(options.ServerSocket, buffers.size(), [&](ServerRequest const& request, std::size_t worker)
+    {
+        return HandleServerRequest(request, buffers[worker]);
+    });
+
+    if (!server.Listen())
+        return false;
+
+    printf("Listening on %s with %zu workers\n", options.ServerSocket.c_str(), server.GetWorkerCount());
+    server.Run();
+    return true;
 }
 
 namespace WDBtoPKT
@@ -169,45 +998,31 @@ namespace WDBtoPKT
 public ref class WDBtoPKT
 {
 public:
-    static void Run(array<System::String^>^ args)
+    static int Run(array<System::String^>^ args)
     {
         WowPacketParser::Program::SetUpConsole();
 
+        std::vector<std::string> arguments;
         for (int i = 0; i < args->Length; ++i)
-        {
-            FILE* inFile = nullptr;
-            std::string inPathString = msclr::interop::marshal_as<std::string>(args[i]->ToString());
-            if (fopen_s(&inFile, inPathString.c_str(), "rb") || !inFile)
-                continue;
-
-            std::filesystem::path inPath(inPathString);
-            std::uintmax_t size = std::filesystem::file_size(inPath);
-
-            ByteBuffer data(size, ByteBuffer::Resize{ });
-
-            fread(data.data(), size, 1, inFile);
-
-            try
-            {
-                ByteBuffer pkt;
-                std::size_t processedRecords = ProcessWDB(data, pkt);
-                if (processedRecords > 0)
-                {
-                    FILE* out = nullptr;
-                    if (!fopen_s(&out, inPath.replace_filename(inPath.filename().replace_extension("pkt")).string().c_str(), "wb") && out)
-                    {
-                        fwrite(pkt.data(), pkt.size(), 1, out);
-                        fclose(out);
-                    }
-                }
-            }
-            catch (std::exception const& ex)
-            {
-                printf("Caught exception when processing %s: %s", inPath.filename().string().c_str(), ex.what());
-            }
-
-            fclose(inFile);
-        }
+            arguments.push_back(msclr::interop::marshal_as<std::string>(args[i]->ToString()));
+
+        ConversionOptions options;
+        std::vector<std::string> inputs;
+        if (!ParseArguments(arguments, options, inputs))
+            return 1;
+
+        Trace::Initialize();
+
+        int result = 0;
+        if (!options.ServerSocket.empty())
+            result = RunServer(options) ? 0 : 1;
+        else if (options.Verify)
+            result = VerifyFiles(inputs, options) ? 0 : 1;
+        else
+            ConvertFiles(inputs, options);
+
+        Trace::Shutdown();
+        return result;
     }
 };
 }
@@ -2,10 +2,10 @@ namespace WDBtoPKT
 {
     public static class Program
     {
-        public static void Main(string[] args)
+        public static int Main(string[] args)
         {
             // C++/CLI can only be compiled to a dll, so we have this dummy runner
-            WDBtoPKT.Run(args);
+            return WDBtoPKT.Run(args);
         }
     }
 }